@@ -0,0 +1,376 @@
+/*
+ | libftdi-i2c bus owner: lets many threads share one I2C bus.
+ | Threads submit requests to a lock-free queue, a bus owner thread takes whatever is queued
+ | and sends it as one MPSSE batch per USB transfer, so more threads mean bigger batches
+ | instead of more lock contention.
+ |
+ | Requests are scheduled by priority class and earliest deadline within a class.
+ | Batches are bounded to FTDI_I2C_BUS_BATCH_BYTES bytes on the bus and long requests go out in
+ | slices of whole transactions, so an urgent request waits for one batch at most.
+ |
+ | Written by Ori Idan, Helicon technologies LTD. (ori@helicontech.co.il)
+ |
+ | libftdi-i2c is free software: you can redistribute it and/or modify it
+ | under the terms of the GNU General Public License as published by the
+ | Free Software Foundation, either version 3 of the License, or
+ | (at your option) any later version.
+ |
+ | libftdi-i2c is distributed in the hope that it will be useful, but
+ | WITHOUT ANY WARRANTY; without even the implied warranty of
+ | MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ | See the GNU General Public License for more details.
+ |
+ | You should have received a copy of the GNU General Public License along
+ | with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <limits.h>
+#include "ftdi-i2c-bus.h"
+
+/*
+ | Priority classes in the order they are served
+ */
+static const int ServiceOrder[FTDI_I2C_PRIO_CLASSES] = { FTDI_I2C_PRIO_HIGH, FTDI_I2C_PRIO_NORMAL, FTDI_I2C_PRIO_BULK };
+
+/*
+ | Push:
+ | Add request to submission queue, safe to call from any number of threads.
+ */
+static void Push(struct ftdi_i2c_bus *bus, struct ftdi_i2c_request *req) {
+	struct ftdi_i2c_request *prev;
+
+	atomic_store_explicit(&req->next, NULL, memory_order_relaxed);
+	prev = atomic_exchange(&bus->head, req);
+	atomic_store_explicit(&prev->next, req, memory_order_release);
+}
+
+/*
+ | Pop:
+ | Take oldest request from submission queue, called by the bus owner only.
+ | Return NULL if the queue is empty or a producer is in the middle of Push().
+ */
+static struct ftdi_i2c_request *Pop(struct ftdi_i2c_bus *bus) {
+	struct ftdi_i2c_request *tail = bus->tail;
+	struct ftdi_i2c_request *next = atomic_load_explicit(&tail->next, memory_order_acquire);
+
+	if(tail == &bus->stub) {
+		if(next == NULL)
+			return NULL;
+		bus->tail = next;
+		tail = next;
+		next = atomic_load_explicit(&next->next, memory_order_acquire);
+	}
+	if(next != NULL) {
+		bus->tail = next;
+		return tail;
+	}
+	if(tail != atomic_load(&bus->head))
+		return NULL;
+	/* tail is the last request, put stub behind it so it can be taken */
+	Push(bus, &bus->stub);
+	next = atomic_load_explicit(&tail->next, memory_order_acquire);
+	if(next != NULL) {
+		bus->tail = next;
+		return tail;
+	}
+	return NULL;
+}
+
+/*
+ | Empty:
+ | Return 1 if nothing was submitted since the last Pop().
+ */
+static int Empty(struct ftdi_i2c_bus *bus) {
+	return atomic_load(&bus->head) == bus->tail;
+}
+
+/*
+ | Ready:
+ | Add request taken from the submission queue to its priority class list.
+ | The list is kept in deadline order, requests with the same deadline stay in submission order.
+ */
+static void Ready(struct ftdi_i2c_bus *bus, struct ftdi_i2c_request *req) {
+	struct ftdi_i2c_request **pp;
+
+	if(req->priority < 0 || req->priority >= FTDI_I2C_PRIO_CLASSES)
+		req->priority = FTDI_I2C_PRIO_NORMAL;
+	pp = &bus->ready[req->priority];
+	while(*pp != NULL && (*pp)->deadline_ns <= req->deadline_ns)
+		pp = &(*pp)->sched_next;
+	req->sched_next = *pp;
+	*pp = req;
+}
+
+/*
+ | SliceLength:
+ | Return number of messages of the next slice of request, made of whole transactions
+ | (ending with FTDI_I2C_M_STOP or the last message) worth up to budget bytes on the bus.
+ | A slice has at least one transaction even if it is bigger than budget.
+ | The slice cost in bytes is stored in cost.
+ */
+static int SliceLength(struct ftdi_i2c_request *req, int budget, int *cost) {
+	int m = req->next_msg;
+	int end = m;
+	int c = 0;
+
+	*cost = 0;
+	while(m < req->nmsgs) {
+		c += req->msgs[m].len + 1;	// Data and address
+		m++;
+		if(m == req->nmsgs || (req->msgs[m - 1].flags & FTDI_I2C_M_STOP)) {
+			if(c > budget && end > req->next_msg)
+				break;
+			end = m;
+			*cost = c;
+			if(c >= budget)
+				break;
+		}
+	}
+	return end - req->next_msg;
+}
+
+/*
+ | BuildBatch:
+ | Queue the next slice of the most urgent requests, highest class first.
+ | High priority requests are never sliced, others share FTDI_I2C_BUS_BATCH_BYTES.
+ | The mux writes of batch[i] report to muxstatus[i], see MuxErrors().
+ | Return number of requests in batch.
+ */
+static int BuildBatch(struct ftdi_i2c_bus *bus, struct ftdi_i2c_request **batch, int *muxstatus) {
+	struct ftdi_i2c_request *req;
+	int budget = FTDI_I2C_BUS_BATCH_BYTES;
+	int n = 0;
+	int i, c, m, cost, slice;
+
+	for(i = 0; i < FTDI_I2C_PRIO_CLASSES; i++) {
+		c = ServiceOrder[i];
+		for(req = bus->ready[c]; req != NULL && n < FTDI_I2C_BUS_MAX_BATCH; req = req->sched_next) {
+			if(c == FTDI_I2C_PRIO_HIGH)
+				slice = INT_MAX;	// Whole request
+			else if(budget <= 0)
+				break;
+			else
+				slice = (budget < FTDI_I2C_BUS_SLICE_BYTES) ? budget : FTDI_I2C_BUS_SLICE_BYTES;
+			m = SliceLength(req, slice, &cost);
+			/*
+			 | Mux state may have changed since the last slice, nothing is sent if it did not.
+			 | The select is planned from the state left by the requests queued before, so
+			 | requests on other channels follow each other in the same stream.
+			 */
+			muxstatus[n] = 0;
+			if(req->path != NULL)
+				cost += 2 * ftdi_i2c_queue_select(bus->ctx, req->path, &muxstatus[n]);	// Mux address and channel mask
+			if(ftdi_i2c_queue(bus->ctx, req->msgs + req->next_msg, m, &req->status) < 0)
+				req->status = FTDI_I2C_EINVAL;
+			req->next_msg += m;
+			budget -= cost;
+			batch[n++] = req;
+		}
+	}
+	return n;
+}
+
+/*
+ | MuxErrors:
+ | Pass failed mux writes of a batch on to its requests.
+ | A failed write leaves the mux state unknown, so the request that queued it and all requests
+ | after it in the stream relied on a select that did not happen and may have reached the
+ | wrong device. Requests queued before it are not affected.
+ */
+static void MuxErrors(struct ftdi_i2c_request **batch, const int *muxstatus, int n) {
+	int err = 0;
+	int i;
+
+	for(i = 0; i < n; i++) {
+		if(err == 0)
+			err = muxstatus[i];
+		if(err < 0 && batch[i]->status == 0)
+			batch[i]->status = err;
+	}
+}
+
+/*
+ | Complete:
+ | Report request result to its submitter.
+ | The request is handed back before the callback runs, so the callback may resubmit or free it;
+ | neither the bus owner nor this function touch it afterwards.
+ */
+static void Complete(struct ftdi_i2c_request *req) {
+	void (*done)(struct ftdi_i2c_request *req) = req->done;
+
+	if(req->status == 0)
+		req->status = req->nmsgs;
+	atomic_store_explicit(&req->completed, 1, memory_order_release);
+	if(done != NULL)
+		done(req);
+}
+
+/*
+ | Finished:
+ | Remove requests that are done or failed from the class lists and account their latency.
+ | Return number of finished requests moved to the start of batch.
+ */
+static int Finished(struct ftdi_i2c_bus *bus, struct ftdi_i2c_request **batch, int n) {
+	struct ftdi_i2c_request **pp, *req;
+	struct ftdi_i2c_class_stats *st;
+	unsigned long long now = ftdi_i2c_time();
+	unsigned long long latency;
+	int i;
+	int done = 0;
+
+	pthread_mutex_lock(&bus->lock);
+	for(i = 0; i < n; i++) {
+		req = batch[i];
+		if(req->next_msg < req->nmsgs && req->status == 0)
+			continue;
+		for(pp = &bus->ready[req->priority]; *pp != req; pp = &(*pp)->sched_next)
+			;
+		*pp = req->sched_next;
+		st = &bus->stats[req->priority];
+		latency = now - req->submit_ns;
+		st->requests++;
+		st->total_ns += latency;
+		if(latency > st->max_ns)
+			st->max_ns = latency;
+		if(now > req->deadline_ns)
+			st->missed++;
+		batch[done++] = req;
+	}
+	pthread_mutex_unlock(&bus->lock);
+	return done;
+}
+
+/*
+ | BusOwner:
+ | Bus owner thread, sends queued requests in batches.
+ */
+static void *BusOwner(void *arg) {
+	struct ftdi_i2c_bus *bus = arg;
+	struct ftdi_i2c_request *batch[FTDI_I2C_BUS_MAX_BATCH];
+	int muxstatus[FTDI_I2C_BUS_MAX_BATCH];
+	struct ftdi_i2c_request *req;
+	int n, i;
+
+	while(1) {
+		while((req = Pop(bus)) != NULL)
+			Ready(bus, req);
+		n = BuildBatch(bus, batch, muxstatus);
+		if(n == 0) {
+			if(atomic_load(&bus->stop))
+				break;
+			/* Sleep until something is submitted, Empty() is checked again with sleeping set */
+			pthread_mutex_lock(&bus->lock);
+			atomic_store(&bus->sleeping, 1);
+			while(Empty(bus) && !atomic_load(&bus->stop))
+				pthread_cond_wait(&bus->wake, &bus->lock);
+			atomic_store(&bus->sleeping, 0);
+			pthread_mutex_unlock(&bus->lock);
+			continue;
+		}
+
+		/* All slices of the batch go out in one command stream, mux selects included */
+		ftdi_i2c_flush(bus->ctx);
+		MuxErrors(batch, muxstatus, n);
+		bus->batches++;
+		n = Finished(bus, batch, n);
+		bus->requests += n;
+		for(i = 0; i < n; i++)
+			Complete(batch[i]);
+		if(n) {
+			pthread_mutex_lock(&bus->lock);
+			pthread_cond_broadcast(&bus->done);
+			pthread_mutex_unlock(&bus->lock);
+		}
+	}
+	return NULL;
+}
+
+/*
+ | ftdi_i2c_bus_start:
+ | Start bus owner thread for an open context.
+ | From now on the context must be used only through ftdi_i2c_submit().
+ | Return 0 on success, FTDI_I2C_EIO if the thread can't be created.
+ */
+int ftdi_i2c_bus_start(struct ftdi_i2c_bus *bus, struct ftdi_i2c_context *ctx) {
+	bus->ctx = ctx;
+	atomic_store(&bus->stub.next, NULL);
+	atomic_store(&bus->head, &bus->stub);
+	bus->tail = &bus->stub;
+	atomic_store(&bus->sleeping, 0);
+	atomic_store(&bus->stop, 0);
+	bus->batches = 0;
+	bus->requests = 0;
+	memset(bus->ready, 0, sizeof(bus->ready));
+	memset(bus->stats, 0, sizeof(bus->stats));
+	pthread_mutex_init(&bus->lock, NULL);
+	pthread_cond_init(&bus->wake, NULL);
+	pthread_cond_init(&bus->done, NULL);
+	if(pthread_create(&bus->thread, NULL, BusOwner, bus) != 0) {
+		printf("Can't create bus owner thread\n");
+		return FTDI_I2C_EIO;
+	}
+	return 0;
+}
+
+/*
+ | ftdi_i2c_bus_stop:
+ | Complete whatever was submitted and stop the bus owner thread.
+ | The context may be used directly again afterwards.
+ */
+void ftdi_i2c_bus_stop(struct ftdi_i2c_bus *bus) {
+	pthread_mutex_lock(&bus->lock);
+	atomic_store(&bus->stop, 1);
+	pthread_cond_signal(&bus->wake);
+	pthread_mutex_unlock(&bus->lock);
+	pthread_join(bus->thread, NULL);
+	pthread_cond_destroy(&bus->done);
+	pthread_cond_destroy(&bus->wake);
+	pthread_mutex_destroy(&bus->lock);
+}
+
+/*
+ | ftdi_i2c_submit:
+ | Submit request to the bus owner, does not wait.
+ | msgs, nmsgs, path, done, priority and deadline_us must be set by the caller.
+ | Completion is reported by the done callback or by ftdi_i2c_wait().
+ */
+void ftdi_i2c_submit(struct ftdi_i2c_bus *bus, struct ftdi_i2c_request *req) {
+	req->status = 0;
+	req->next_msg = 0;
+	req->submit_ns = ftdi_i2c_time();
+	req->deadline_ns = req->deadline_us ? req->submit_ns + req->deadline_us * 1000ULL : ~0ULL;
+	atomic_store_explicit(&req->completed, 0, memory_order_relaxed);
+	Push(bus, req);
+	/* Lock only if the owner went to sleep, it checks the queue again after setting sleeping */
+	if(atomic_load(&bus->sleeping)) {
+		pthread_mutex_lock(&bus->lock);
+		pthread_cond_signal(&bus->wake);
+		pthread_mutex_unlock(&bus->lock);
+	}
+}
+
+/*
+ | ftdi_i2c_wait:
+ | Wait for a submitted request to complete.
+ | Return number of messages or FTDI_I2C_xxx error code.
+ */
+int ftdi_i2c_wait(struct ftdi_i2c_bus *bus, struct ftdi_i2c_request *req) {
+	if(!atomic_load_explicit(&req->completed, memory_order_acquire)) {
+		pthread_mutex_lock(&bus->lock);
+		while(!atomic_load_explicit(&req->completed, memory_order_acquire))
+			pthread_cond_wait(&bus->done, &bus->lock);
+		pthread_mutex_unlock(&bus->lock);
+	}
+	return req->status;
+}
+
+/*
+ | ftdi_i2c_bus_stats:
+ | Get latency statistics of a priority class, call before ftdi_i2c_bus_stop().
+ */
+void ftdi_i2c_bus_stats(struct ftdi_i2c_bus *bus, int priority, struct ftdi_i2c_class_stats *stats) {
+	pthread_mutex_lock(&bus->lock);
+	*stats = bus->stats[priority];
+	pthread_mutex_unlock(&bus->lock);
+}
@@ -0,0 +1,104 @@
+/*
+ | libftdi-i2c bus owner: lets many threads share one I2C bus.
+ |
+ | Written by Ori Idan, Helicon technologies LTD. (ori@helicontech.co.il)
+ |
+ | libftdi-i2c is free software: you can redistribute it and/or modify it
+ | under the terms of the GNU General Public License as published by the
+ | Free Software Foundation, either version 3 of the License, or
+ | (at your option) any later version.
+ |
+ | libftdi-i2c is distributed in the hope that it will be useful, but
+ | WITHOUT ANY WARRANTY; without even the implied warranty of
+ | MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ | See the GNU General Public License for more details.
+ |
+ | You should have received a copy of the GNU General Public License along
+ | with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef FTDI_I2C_BUS_H
+#define FTDI_I2C_BUS_H
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include "ftdi-i2c.h"
+
+#define FTDI_I2C_BUS_MAX_BATCH 64	// Maximum requests sent in one USB transfer
+#define FTDI_I2C_BUS_BATCH_BYTES 128	// Bytes on the bus per USB transfer, bounds the wait of urgent requests
+#define FTDI_I2C_BUS_SLICE_BYTES 32	// Bytes on the bus per slice of a request
+
+/*
+ | Priority classes, a class is served only when all higher classes are idle.
+ | NORMAL is 0 so zero initialized requests are normal.
+ */
+#define FTDI_I2C_PRIO_NORMAL 0
+#define FTDI_I2C_PRIO_HIGH 1	// Control loops
+#define FTDI_I2C_PRIO_BULK 2	// EEPROM and log dumps
+#define FTDI_I2C_PRIO_CLASSES 3
+
+/*
+ | Latency statistics of a priority class.
+ | Latency is measured from ftdi_i2c_submit() until completion.
+ */
+struct ftdi_i2c_class_stats {
+	unsigned long requests;
+	unsigned long missed;	// Requests completed after their deadline
+	unsigned long long total_ns;
+	unsigned long long max_ns;
+};
+
+/*
+ | A transfer submitted to the bus owner.
+ | The request and its messages belong to the bus owner from ftdi_i2c_submit() until it completed.
+ | The done callback gets the request back and may resubmit it (periodic polling) or free it,
+ | so a request with a callback must not be freed by a thread waiting for it.
+ | Messages ending with FTDI_I2C_M_STOP split the request into I2C transactions, long requests
+ | are sent in slices of whole transactions so urgent requests can go in between.
+ | A transaction is never split, a single long message (such as a whole EEPROM read) goes out
+ | in one piece and delays urgent requests for all of its time on the bus.
+ */
+struct ftdi_i2c_request {
+	struct ftdi_i2c_msg *msgs;
+	int nmsgs;
+	const struct i2c_path *path;	// Mux path to select before the transfer, NULL if none
+	void (*done)(struct ftdi_i2c_request *req);	// Called by the bus owner thread on completion, may be NULL
+	void *arg;	// For use by the caller
+	int priority;	// FTDI_I2C_PRIO_xxx
+	unsigned long deadline_us;	// Deadline relative to submission, 0 if none
+	int status;	// Number of messages or FTDI_I2C_xxx error code, valid once completed
+	atomic_int completed;
+	struct ftdi_i2c_request *_Atomic next;	// Submission queue link
+	/* Used by the bus owner */
+	unsigned long long submit_ns, deadline_ns;
+	int next_msg;	// First message not sent yet
+	struct ftdi_i2c_request *sched_next;	// Priority class list link
+};
+
+/*
+ | Bus owner: a thread that is the only user of the context.
+ | Submission is a lock-free multi producer single consumer queue (Vyukov's intrusive queue),
+ | the mutex is used only to sleep when there is nothing to do.
+ */
+struct ftdi_i2c_bus {
+	struct ftdi_i2c_context *ctx;
+	struct ftdi_i2c_request *_Atomic head;	// Last submitted request, producers swap it
+	struct ftdi_i2c_request *tail;	// Next request to take, used by the owner only
+	struct ftdi_i2c_request stub;
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;	// Signalled when a request is submitted while the owner sleeps
+	pthread_cond_t done;	// Broadcast when requests complete
+	atomic_int sleeping;
+	atomic_int stop;
+	struct ftdi_i2c_request *ready[FTDI_I2C_PRIO_CLASSES];	// Requests taken from the queue, earliest deadline first
+	unsigned long batches, requests;	// Statistics
+	struct ftdi_i2c_class_stats stats[FTDI_I2C_PRIO_CLASSES];	// Protected by lock
+};
+
+int ftdi_i2c_bus_start(struct ftdi_i2c_bus *bus, struct ftdi_i2c_context *ctx);
+void ftdi_i2c_bus_stop(struct ftdi_i2c_bus *bus);
+void ftdi_i2c_submit(struct ftdi_i2c_bus *bus, struct ftdi_i2c_request *req);
+int ftdi_i2c_wait(struct ftdi_i2c_bus *bus, struct ftdi_i2c_request *req);
+void ftdi_i2c_bus_stats(struct ftdi_i2c_bus *bus, int priority, struct ftdi_i2c_class_stats *stats);
+
+#endif
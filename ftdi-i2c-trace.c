@@ -0,0 +1,127 @@
+/*
+ | libftdi-i2c MPSSE trace capture.
+ | Every buffer written to or read from the FT4232H is recorded with timestamps.
+ | Records are collected in memory and written in big blocks, no formatting is done
+ | while capturing, so tracing is cheap enough to leave on.
+ | Use i2ctrace to decode or replay the trace.
+ |
+ | Written by Ori Idan, Helicon technologies LTD. (ori@helicontech.co.il)
+ |
+ | libftdi-i2c is free software: you can redistribute it and/or modify it
+ | under the terms of the GNU General Public License as published by the
+ | Free Software Foundation, either version 3 of the License, or
+ | (at your option) any later version.
+ |
+ | libftdi-i2c is distributed in the hope that it will be useful, but
+ | WITHOUT ANY WARRANTY; without even the implied warranty of
+ | MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ | See the GNU General Public License for more details.
+ |
+ | You should have received a copy of the GNU General Public License along
+ | with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "ftdi-i2c.h"
+#include "ftdi-i2c-trace.h"
+
+/*
+ | Put32, Put64:
+ | Store little endian numbers.
+ */
+static void Put32(unsigned char *p, unsigned long v) {
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+static void Put64(unsigned char *p, unsigned long long v) {
+	Put32(p, v & 0xFFFFFFFF);
+	Put32(p + 4, v >> 32);
+}
+
+/*
+ | ftdi_i2c_trace_open:
+ | Start recording everything sent to and read from the FT4232H to filename.
+ | Return 0 on success, -1 on error.
+ */
+int ftdi_i2c_trace_open(struct ftdi_i2c_context *ctx, const char *filename) {
+	unsigned char header[FTDI_I2C_TRACE_HEADER_SIZE];
+
+	ctx->TraceBuffer = malloc(FTDI_I2C_TRACE_BUFFER);
+	if(ctx->TraceBuffer == NULL)
+		return -1;
+	ctx->TraceFd = open(filename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if(ctx->TraceFd < 0) {
+		printf("Can't open trace file %s\n", filename);
+		free(ctx->TraceBuffer);
+		ctx->TraceBuffer = NULL;
+		return -1;
+	}
+	memcpy(header, FTDI_I2C_TRACE_MAGIC, 8);
+	Put32(header + 8, ctx->dwClockDivisor);
+	Put32(header + 12, 0);
+	memcpy(ctx->TraceBuffer, header, sizeof(header));
+	ctx->dwTraceBytes = sizeof(header);
+	return 0;
+}
+
+/*
+ | ftdi_i2c_trace_record:
+ | Add record of one USB write or read to the trace.
+ */
+void ftdi_i2c_trace_record(struct ftdi_i2c_context *ctx, unsigned char type, const unsigned char *buf, int len, unsigned long long start_ns, unsigned long long end_ns) {
+	unsigned char *p;
+
+	if(ctx->TraceBuffer == NULL)
+		return;
+	if(len < 0)
+		len = 0;
+	if(ctx->dwTraceBytes + FTDI_I2C_TRACE_RECORD_SIZE + len > FTDI_I2C_TRACE_BUFFER)
+		ftdi_i2c_trace_flush(ctx);
+	p = ctx->TraceBuffer + ctx->dwTraceBytes;
+	p[0] = type;
+	p[1] = p[2] = p[3] = 0;
+	Put32(p + 4, len);
+	Put64(p + 8, start_ns);
+	Put32(p + 16, (end_ns - start_ns) / 1000);
+	ctx->dwTraceBytes += FTDI_I2C_TRACE_RECORD_SIZE;
+	if(ctx->dwTraceBytes + len > FTDI_I2C_TRACE_BUFFER) {
+		/* Too big for the buffer, write it directly */
+		ftdi_i2c_trace_flush(ctx);
+		if(write(ctx->TraceFd, buf, len) != len)
+			printf("Error writing trace\n");
+		return;
+	}
+	memcpy(ctx->TraceBuffer + ctx->dwTraceBytes, buf, len);
+	ctx->dwTraceBytes += len;
+}
+
+/*
+ | ftdi_i2c_trace_flush:
+ | Write collected records to the trace file.
+ */
+void ftdi_i2c_trace_flush(struct ftdi_i2c_context *ctx) {
+	if(ctx->TraceBuffer == NULL || ctx->dwTraceBytes == 0)
+		return;
+	if(write(ctx->TraceFd, ctx->TraceBuffer, ctx->dwTraceBytes) != ctx->dwTraceBytes)
+		printf("Error writing trace\n");
+	ctx->dwTraceBytes = 0;
+}
+
+/*
+ | ftdi_i2c_trace_close:
+ | Write what is left and stop recording.
+ */
+void ftdi_i2c_trace_close(struct ftdi_i2c_context *ctx) {
+	if(ctx->TraceBuffer == NULL)
+		return;
+	ftdi_i2c_trace_flush(ctx);
+	close(ctx->TraceFd);
+	free(ctx->TraceBuffer);
+	ctx->TraceBuffer = NULL;
+}
@@ -0,0 +1,45 @@
+/*
+ | libftdi-i2c MPSSE trace file format.
+ |
+ | Written by Ori Idan, Helicon technologies LTD. (ori@helicontech.co.il)
+ |
+ | libftdi-i2c is free software: you can redistribute it and/or modify it
+ | under the terms of the GNU General Public License as published by the
+ | Free Software Foundation, either version 3 of the License, or
+ | (at your option) any later version.
+ |
+ | libftdi-i2c is distributed in the hope that it will be useful, but
+ | WITHOUT ANY WARRANTY; without even the implied warranty of
+ | MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ | See the GNU General Public License for more details.
+ |
+ | You should have received a copy of the GNU General Public License along
+ | with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef FTDI_I2C_TRACE_H
+#define FTDI_I2C_TRACE_H
+
+/*
+ | A trace file starts with a 16 byte header:
+ |   8 bytes magic "FTI2CTR1", 4 bytes clock divisor, 4 bytes reserved
+ | followed by one record for each ftdi_write_data / ftdi_read_data call:
+ |   1 byte type ('W' or 'R'), 3 bytes reserved, 4 bytes data length,
+ |   8 bytes start time (ns, monotonic clock), 4 bytes duration (us), then the data.
+ | All numbers are little endian.
+ | For 'R' records the data is what the FT4232H sent back.
+ */
+#define FTDI_I2C_TRACE_MAGIC "FTI2CTR1"
+#define FTDI_I2C_TRACE_HEADER_SIZE 16
+#define FTDI_I2C_TRACE_RECORD_SIZE 20	// Record size without data
+#define FTDI_I2C_TRACE_WRITE 'W'
+#define FTDI_I2C_TRACE_READ 'R'
+#define FTDI_I2C_TRACE_BUFFER 65536	// Records are kept in memory until this much is collected
+
+struct ftdi_i2c_context;
+
+int ftdi_i2c_trace_open(struct ftdi_i2c_context *ctx, const char *filename);
+void ftdi_i2c_trace_record(struct ftdi_i2c_context *ctx, unsigned char type, const unsigned char *buf, int len, unsigned long long start_ns, unsigned long long end_ns);
+void ftdi_i2c_trace_flush(struct ftdi_i2c_context *ctx);
+void ftdi_i2c_trace_close(struct ftdi_i2c_context *ctx);
+
+#endif
@@ -0,0 +1,830 @@
+/*
+ | libftdi-i2c: I2C master using libftdi and FT4232 chip connected to USB.
+ | All state is kept in struct ftdi_i2c_context, so several buses may be used in one program.
+ |
+ | Transfers are built as one MPSSE command stream: ACK bits and read data are collected
+ | by the FT4232H and read back once at the end, so a transfer costs a single USB round trip.
+ |
+ | Written by Ori Idan, Helicon technologies LTD. (ori@helicontech.co.il)
+ |
+ | libftdi-i2c is free software: you can redistribute it and/or modify it
+ | under the terms of the GNU General Public License as published by the
+ | Free Software Foundation, either version 3 of the License, or
+ | (at your option) any later version.
+ |
+ | libftdi-i2c is distributed in the hope that it will be useful, but
+ | WITHOUT ANY WARRANTY; without even the implied warranty of
+ | MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ | See the GNU General Public License for more details.
+ |
+ | You should have received a copy of the GNU General Public License along
+ | with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "ftdi-i2c.h"
+#include "ftdi-i2c-trace.h"
+
+/*
+ | Constants
+ */
+static const unsigned char MSB_FALLING_EDGE_CLOCK_BYTE_IN = '\x24';
+static const unsigned char MSB_FALLING_EDGE_CLOCK_BYTE_OUT = '\x11';
+static const unsigned char MSB_RISING_EDGE_CLOCK_BIT_IN = '\x22';
+
+/*
+ | ftdi_i2c_time:
+ | Return monotonic time in ns, used for timeouts, traces and bus statistics.
+ */
+unsigned long long ftdi_i2c_time(void) {
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ | WriteCommands:
+ | Send queued commands to the FT4232H.
+ */
+static int WriteCommands(struct ftdi_i2c_context *ctx) {
+	unsigned long long start;
+	int r = 0;
+
+	if(ctx->dwNumBytesToSend) {
+		if(ctx->TraceBuffer == NULL)
+			r = ftdi_write_data(&ctx->ftdic, ctx->OutputBuffer, ctx->dwNumBytesToSend);
+		else {
+			start = ftdi_i2c_time();
+			r = ftdi_write_data(&ctx->ftdic, ctx->OutputBuffer, ctx->dwNumBytesToSend);
+			ftdi_i2c_trace_record(ctx, FTDI_I2C_TRACE_WRITE, ctx->OutputBuffer, ctx->dwNumBytesToSend, start, ftdi_i2c_time());
+		}
+	}
+	ctx->dwNumBytesToSend = 0;	// Clear output buffer
+	return (r < 0) ? FTDI_I2C_EIO : 0;
+}
+
+/*
+ | ReadData:
+ | Read bytes sent back by the FT4232H.
+ | ftdi_read_data() returns what arrived so far whenever the latency timer expires, while long
+ | command streams are still running, so we read until len bytes arrived or nothing came
+ | for ReadTimeout ms.
+ | Return number of bytes read (less than len on timeout) or libftdi error code.
+ */
+static int ReadData(struct ftdi_i2c_context *ctx, unsigned char *buf, unsigned int len) {
+	unsigned long long start;
+	unsigned long long deadline = ftdi_i2c_time() + ctx->ReadTimeout * 1000000ULL;
+	unsigned int count = 0;
+	int r;
+
+	while(count < len) {
+		start = ftdi_i2c_time();
+		r = ftdi_read_data(&ctx->ftdic, buf + count, len - count);
+		if(ctx->TraceBuffer != NULL)
+			ftdi_i2c_trace_record(ctx, FTDI_I2C_TRACE_READ, buf + count, r, start, ftdi_i2c_time());
+		if(r < 0)
+			return r;
+		if(r > 0)
+			deadline = ftdi_i2c_time() + ctx->ReadTimeout * 1000000ULL;	// Still running, wait for the rest
+		else if(ftdi_i2c_time() > deadline)
+			break;
+		count += r;
+	}
+	return count;
+}
+
+/*
+ | Reserve:
+ | Make room for n command bytes.
+ | Commands queued so far are sent if the buffer is full, the ACK bits and data they
+ | produce are still read by ftdi_i2c_flush().
+ */
+static void Reserve(struct ftdi_i2c_context *ctx, unsigned int n) {
+	if(ctx->dwNumBytesToSend + n > sizeof(ctx->OutputBuffer))
+		WriteCommands(ctx);
+}
+
+/*
+ | ExpectRx:
+ | Record that queued commands will send back len bytes.
+ | Consecutive ACK bits of the same transfer are merged into one segment.
+ | ACK bits queued by ftdi_i2c_write_async() belong to the frame being queued.
+ */
+static void ExpectRx(struct ftdi_i2c_context *ctx, unsigned char *buf, unsigned int len, int *status, int mux) {
+	struct ftdi_i2c_segment *seg;
+
+	if(ctx->dwNumSegments) {
+		seg = &ctx->Segments[ctx->dwNumSegments - 1];
+		if(buf == NULL && seg->buf == NULL && seg->status == status && seg->mux == mux && seg->frame == ctx->QueueFrame) {
+			seg->len += len;
+			ctx->dwNumRxPending += len;
+			return;
+		}
+	}
+	seg = &ctx->Segments[ctx->dwNumSegments++];
+	seg->buf = buf;
+	seg->len = len;
+	seg->status = status;
+	seg->mux = mux;
+	seg->frame = ctx->QueueFrame;
+	seg->gpiol = 0;
+	ctx->dwNumRxPending += len;
+}
+
+/*
+ | SetStatus:
+ | Record error in status of a transfer, the first error is kept.
+ */
+static void SetStatus(int *status, int err) {
+	if(status != NULL && *status == 0)
+		*status = err;
+}
+
+/*
+ | SegmentError:
+ | Record USB error in the transfer or fire-and-forget frame owning a segment.
+ */
+static void SegmentError(struct ftdi_i2c_context *ctx, struct ftdi_i2c_segment *seg) {
+	SetStatus(seg->status, FTDI_I2C_EIO);
+	if(seg->mux && seg->status == NULL)
+		ctx->MuxError = 1;	// Select of ftdi_i2c_select() may not have happened
+	if(seg->frame >= 0)
+		ctx->AsyncEIO = 1;	// Kept until ftdi_i2c_sync() reports it
+}
+
+/*
+ | AsyncError:
+ | Remember fire-and-forget frame that was not acknowledged.
+ */
+static void AsyncError(struct ftdi_i2c_context *ctx, long frame) {
+	if(ctx->dwNumAsyncErrors && ctx->LastAsyncError == frame)
+		return;	// ACK bits of one frame may be in several segments
+	ctx->LastAsyncError = frame;
+	if(ctx->dwNumAsyncErrors < FTDI_I2C_MAX_ASYNC_ERRORS)
+		ctx->AsyncErrors[ctx->dwNumAsyncErrors] = frame;
+	ctx->dwNumAsyncErrors++;
+}
+
+/*
+ | CheckSegments:
+ | Send queued commands and read back ACK bits and data until no more than keep bytes are pending.
+ | Replies are read oldest first, so with keep > 0 the FT4232H goes on with the newer commands
+ | while we read.
+ | Return 0 on success, FTDI_I2C_EIO on USB error (all pending transfers fail then).
+ | Errors are stored in the status of each transfer and for fire-and-forget frames in the
+ | context, so they are not lost when replies are read in the background.
+ */
+static int CheckSegments(struct ftdi_i2c_context *ctx, unsigned int keep) {
+	struct ftdi_i2c_segment *seg;
+	unsigned int i, j;
+	int r = 0;
+	int n;
+
+	if(ctx->dwNumSegments) {
+		Reserve(ctx, 1);
+		ctx->OutputBuffer[ctx->dwNumBytesToSend++] = '\x87'; //Send answer back immediate command
+	}
+	if(WriteCommands(ctx) < 0)
+		r = FTDI_I2C_EIO;
+	for(i = 0; i < ctx->dwNumSegments && (r < 0 || ctx->dwNumRxPending > keep); i++) {
+		seg = &ctx->Segments[i];
+		ctx->dwNumRxPending -= seg->len;
+		if(r < 0) {
+			SegmentError(ctx, seg);
+			continue;
+		}
+		n = ReadData(ctx, seg->buf ? seg->buf : ctx->InputBuffer, seg->len);
+		if(n < 0 || (unsigned int)n != seg->len) {
+			if(ctx->debug)
+				printf("Error reading i2c: %s\n", ftdi_get_error_string(&ctx->ftdic));
+			r = FTDI_I2C_EIO;
+			SegmentError(ctx, seg);
+			continue;
+		}
+		if(seg->buf != NULL) {
+			if(seg->gpiol)
+				*seg->buf >>= 4;	// GPIOL0-3 to bits 0-3
+			continue;
+		}
+		// Check ACK bit 0 on data byte read out
+		for(j = 0; j < seg->len; j++) {
+			if(ctx->debug)
+				printf("Received: %02X\n", ctx->InputBuffer[j]);
+			if(ctx->InputBuffer[j] & 0x01)
+				break;
+		}
+		if(j == seg->len)
+			continue;
+		if(seg->mux) {
+			if(seg->status == NULL)
+				ctx->MuxError = 1;	// Reported by the next ftdi_i2c_transfer() or ftdi_i2c_sync()
+			MuxInvalidate(&ctx->mux);
+		}
+		if(seg->frame >= 0)
+			AsyncError(ctx, seg->frame);
+		SetStatus(seg->status, FTDI_I2C_ENACK);
+	}
+	if(r < 0) {
+		/* Commands and replies are out of step, drop whatever is left */
+		ftdi_usb_purge_buffers(&ctx->ftdic);
+		MuxInvalidate(&ctx->mux);
+	}
+	ctx->dwNumSegments -= i;
+	memmove(ctx->Segments, ctx->Segments + i, ctx->dwNumSegments * sizeof(struct ftdi_i2c_segment));
+	return r;
+}
+
+/*
+ | MakeRoomRx:
+ | Make sure the FT4232H never has to hold more than FTDI_I2C_MAX_PENDING_RX bytes.
+ | Only the oldest replies are read, the FT4232H keeps the bus busy with the rest meanwhile.
+ | Errors are kept in the status of the transfers and frames they hit, see CheckSegments().
+ */
+static void MakeRoomRx(struct ftdi_i2c_context *ctx, unsigned int len) {
+	unsigned int keep = FTDI_I2C_MAX_PENDING_RX / 2;
+
+	if(ctx->dwNumRxPending + len <= FTDI_I2C_MAX_PENDING_RX)
+		return;
+	if(keep > FTDI_I2C_MAX_PENDING_RX - len)
+		keep = FTDI_I2C_MAX_PENDING_RX - len;
+	CheckSegments(ctx, keep);
+}
+
+/*
+ | HighSpeedSetI2CStart:
+ | Generate start condition for I2C bus.
+ | Set SDA and SCL high.
+ | Set SDA low (while SCL remains high)
+ | Set SCL low
+ */
+static void HighSpeedSetI2CStart(struct ftdi_i2c_context *ctx) {
+	unsigned char *OutputBuffer = ctx->OutputBuffer;
+	unsigned char gpio = ctx->gpio;
+	unsigned char gpiodir = ctx->gpiodir << 4;
+	unsigned int dwCount;
+
+	Reserve(ctx, 27);
+	// Repeat commands to ensure the minimum period of the start hold time ie 600ns is achieved
+	for(dwCount=0; dwCount < 4; dwCount++)  {
+		//Command to set directions of lower 8 pins and force value on bits set as output
+		OutputBuffer[ctx->dwNumBytesToSend++] = '\x80';
+		//Set SDA, SCL high, GPIOL0 low
+		OutputBuffer[ctx->dwNumBytesToSend++] = '\x03' | (gpio << 4);
+		//Set SK,DO,GPIOL0 pins as output
+		OutputBuffer[ctx->dwNumBytesToSend++] = '\x03' | gpiodir;
+	}
+
+	// Repeat commands to ensure the minimum period of the start setup time ie 600ns is achieved
+	for(dwCount=0; dwCount < 4; dwCount++) {
+		//Command to set directions of lower 8 pins and force value on bits set as output
+		OutputBuffer[ctx->dwNumBytesToSend++] = '\x80';
+		//Set SDA low, SCL high, GPIOL0 low
+		OutputBuffer[ctx->dwNumBytesToSend++] = '\x01' | (gpio << 4);
+		//Set SK,DO,GPIOL0 pins as output
+		OutputBuffer[ctx->dwNumBytesToSend++] = '\x03' | gpiodir;
+	}
+	//Command to set directions of lower 8 pins and force value on bits set as output
+	OutputBuffer[ctx->dwNumBytesToSend++] = '\x80';
+	//Set SDA, SCL low, GPIOL0 low
+	OutputBuffer[ctx->dwNumBytesToSend++] = '\x00' | (gpio << 4);
+	//Set SK,DO,GPIOL0 pins as output with bit „1‟, other pins as input with bit „0‟
+	OutputBuffer[ctx->dwNumBytesToSend++] = '\x03' | gpiodir;
+}
+
+/*
+ | HighSpeedSetI2CStop:
+ | Generate stop condition for I2C bus.
+ | Set SDA low, SCL high.
+ | Set SDA high (while SCL remains high)
+ | Release both pins by setting them to input mode so they are in tristate (high impidance)
+ */
+static void HighSpeedSetI2CStop(struct ftdi_i2c_context *ctx) {
+	unsigned char *OutputBuffer = ctx->OutputBuffer;
+	unsigned char gpio = ctx->gpio;
+	unsigned char gpiodir = ctx->gpiodir << 4;
+	int dwCount;
+
+	Reserve(ctx, 27);
+	// Repeat commands to ensure the minimum period of the stop setup time ie 600ns is achieved
+	for(dwCount=0; dwCount<4; dwCount++) {
+		//Command to set directions of lower 8 pins and force value on bits set as output
+		OutputBuffer[ctx->dwNumBytesToSend++] = '\x80';
+		//Set SDA low, SCL high, GPIOL0 low
+		OutputBuffer[ctx->dwNumBytesToSend++] = '\x01' | (gpio << 4);
+		//Set SK,DO,GPIOL0 pins as output
+		OutputBuffer[ctx->dwNumBytesToSend++] = '\x03' | gpiodir;
+	}
+
+	// Repeat commands to ensure the minimum period of the stop hold time ie 600ns is achieved
+	for(dwCount=0; dwCount<4; dwCount++) {
+		//Command to set directions of lower 8 pins and force value on bits set as output
+		OutputBuffer[ctx->dwNumBytesToSend++] = '\x80';
+		//Set SDA, SCL high, GPIOL0 low
+		OutputBuffer[ctx->dwNumBytesToSend++] = '\x03' | (gpio << 4);
+		//Set SK,DO,GPIOL0 pins as output
+		OutputBuffer[ctx->dwNumBytesToSend++] = '\x03' | gpiodir;
+	}
+
+	//Tristate the SCL, SDA pins
+	//Command to set directions of lower 8 pins and force value on bits set as output
+	OutputBuffer[ctx->dwNumBytesToSend++] = '\x80';
+	OutputBuffer[ctx->dwNumBytesToSend++] = '\x00' | (gpio << 4);
+	OutputBuffer[ctx->dwNumBytesToSend++] = gpiodir;
+}
+
+/*
+ | QueueByteAndACK:
+ | Queue byte and ACK bit scan.
+ | The ACK bit is read and checked by ftdi_i2c_flush(), result goes to status.
+ */
+static void QueueByteAndACK(struct ftdi_i2c_context *ctx, unsigned char DataSend, int *status, int mux) {
+	unsigned char *OutputBuffer = ctx->OutputBuffer;
+	unsigned char gpio = ctx->gpio;
+	unsigned char gpiodir = ctx->gpiodir << 4;
+
+	MakeRoomRx(ctx, 1);
+	Reserve(ctx, 15);
+	// Clock data byte out on –ve Clock Edge MSB first
+	OutputBuffer[ctx->dwNumBytesToSend++] = MSB_FALLING_EDGE_CLOCK_BYTE_OUT;
+	OutputBuffer[ctx->dwNumBytesToSend++] = '\x00';
+	OutputBuffer[ctx->dwNumBytesToSend++] = '\x00'; //Data length of 0x0000 means 1 byte data to clock out
+	OutputBuffer[ctx->dwNumBytesToSend++] = DataSend; //Add data to be send
+	// Get Acknowledge bit
+	// Command to set directions of lower 8 pins and force value on bits set as output
+	OutputBuffer[ctx->dwNumBytesToSend++] = '\x80';
+	OutputBuffer[ctx->dwNumBytesToSend++] = '\x00' | (gpio << 4); // Set SCL low,
+	//Set SK, GPIOL0 pins as output
+	OutputBuffer[ctx->dwNumBytesToSend++] = '\x01' | gpiodir;
+	//Command to scan in ACK bit , -ve clock Edge MSB first
+	OutputBuffer[ctx->dwNumBytesToSend++] = MSB_RISING_EDGE_CLOCK_BIT_IN;
+	OutputBuffer[ctx->dwNumBytesToSend++] = '\x0';  //Length of 0x0 means to scan in 1 bit
+	//Command to set directions of lower 8 pins and force value on bits set as output
+	OutputBuffer[ctx->dwNumBytesToSend++] = '\x80';
+	// Set SDA high, SCL low
+	OutputBuffer[ctx->dwNumBytesToSend++] = '\x02' | (gpio << 4);
+	//Set SK,DO,GPIOL0 pins as output
+	OutputBuffer[ctx->dwNumBytesToSend++] = '\x03' | gpiodir;
+	ExpectRx(ctx, NULL, 1, status, mux);
+}
+
+/*
+ | QueueReadBytes:
+ | Queue read of readLength I2C bytes to readBuffer.
+ | Every byte is acknowledged except the last one if last is set.
+ | Note that read address must be queued beforehand
+ */
+static void QueueReadBytes(struct ftdi_i2c_context *ctx, unsigned char *readBuffer, unsigned int readLength, int last, int *status) {
+	unsigned char *OutputBuffer = ctx->OutputBuffer;
+	unsigned char gpio = ctx->gpio;
+	unsigned char gpiodir = ctx->gpiodir << 4;
+	unsigned int clock = 60 * 1000/(1+ctx->dwClockDivisor)/2; // K Hz
+	const int loopCount = (clock < 2000) ? (int)(10 * ((float)200/clock)) : 1;
+	unsigned int readCount;
+	unsigned char sda;
+	int i = 0;  // Used only for loop
+
+	MakeRoomRx(ctx, readLength);
+	for(readCount = 0; readCount < readLength; readCount++) {
+		Reserve(ctx, 6 + 9 * loopCount);
+		// Command of read one byte
+		OutputBuffer[ctx->dwNumBytesToSend++] = '\x80'; //Command to set directions of lower 8 pins and force value on bits set as output
+		OutputBuffer[ctx->dwNumBytesToSend++] = '\x00' | (gpio << 4); //Set SCL low
+		OutputBuffer[ctx->dwNumBytesToSend++] = '\x01' | gpiodir; //Set SK, GPIOL pins as output, DO as input so device drives SDA
+		OutputBuffer[ctx->dwNumBytesToSend++] = MSB_FALLING_EDGE_CLOCK_BYTE_IN; //Command to clock data byte in on –ve Clock Edge MSB first
+		OutputBuffer[ctx->dwNumBytesToSend++] = '\x00';
+		OutputBuffer[ctx->dwNumBytesToSend++] = '\x00'; //Data length of 0x0000 means 1 byte data to clock in
+
+		// The last byte is read with NO ACK (SDA high), the others with ACK (SDA low)
+		sda = (last && readCount == readLength - 1) ? '\x02' : '\x00';
+		for (i=0; i != loopCount; ++i)
+		{
+			OutputBuffer[ctx->dwNumBytesToSend++] = '\x80';
+			OutputBuffer[ctx->dwNumBytesToSend++] = sda | (gpio << 4);  // SDA set, SCL Low
+			OutputBuffer[ctx->dwNumBytesToSend++] = '\x03' | gpiodir;
+		}
+
+		for (i=0; i != loopCount; ++i)
+		{
+			OutputBuffer[ctx->dwNumBytesToSend++] = '\x80';
+			OutputBuffer[ctx->dwNumBytesToSend++] = sda | '\x01' | (gpio << 4);  // SDA set, SCL High
+			OutputBuffer[ctx->dwNumBytesToSend++] = '\x03' | gpiodir;
+		}
+
+		for (i=0; i != loopCount; ++i)
+		{
+			OutputBuffer[ctx->dwNumBytesToSend++] = '\x80';
+			OutputBuffer[ctx->dwNumBytesToSend++] = '\x02' | (gpio << 4);  // SDA High, SCL Low
+			OutputBuffer[ctx->dwNumBytesToSend++] = '\x03' | gpiodir;
+		}
+	}
+	ExpectRx(ctx, readBuffer, readLength, status, 0);
+}
+
+/*
+ | ftdi_i2c_flush:
+ | Send queued commands and read back ACK bits and data.
+ | Data goes straight to the buffers given when the reads were queued.
+ | Return 0 on success, FTDI_I2C_EIO on USB error.
+ */
+int ftdi_i2c_flush(struct ftdi_i2c_context *ctx) {
+	return CheckSegments(ctx, 0);
+}
+
+/*
+ | ftdi_i2c_queue_select:
+ | Queue the mux control writes needed to reach the device in path.
+ | If a mux does not acknowledge, the mux state is forgotten and the error stored in status.
+ | Return number of mux writes queued.
+ */
+int ftdi_i2c_queue_select(struct ftdi_i2c_context *ctx, const struct i2c_path *path, int *status) {
+	struct i2c_mux_write writes[I2C_MAX_MUX_WRITES];
+	int i, n;
+
+	n = MuxPlanSelect(&ctx->mux, path, writes);
+	for(i = 0; i < n; i++) {
+		if(ctx->debug)
+			printf("Mux %02X: %02X\n", writes[i].mux, writes[i].value);
+		HighSpeedSetI2CStart(ctx);
+		QueueByteAndACK(ctx, writes[i].mux << 1, status, 1);
+		QueueByteAndACK(ctx, writes[i].value, status, 1);
+		HighSpeedSetI2CStop(ctx);
+	}
+	return n;
+}
+
+/*
+ | ftdi_i2c_select:
+ | Queue the mux control writes needed to reach the device in path.
+ | Nothing is sent, the writes go out with the following transfer or frames.
+ | A mux that does not acknowledge makes the following ftdi_i2c_transfer() or ftdi_i2c_sync() fail.
+ */
+void ftdi_i2c_select(struct ftdi_i2c_context *ctx, const struct i2c_path *path) {
+	ftdi_i2c_queue_select(ctx, path, NULL);
+}
+
+/*
+ | ftdi_i2c_queue:
+ | Queue the commands of a transfer without sending them.
+ | status must be 0 and stay valid until ftdi_i2c_flush(), errors are stored there.
+ | Read data goes to the message buffers on flush.
+ | Return 0 or FTDI_I2C_EINVAL if nmsgs is negative or a message is invalid (nothing is queued then).
+ */
+int ftdi_i2c_queue(struct ftdi_i2c_context *ctx, struct ftdi_i2c_msg *msgs, int nmsgs, int *status) {
+	unsigned int i;
+	int m, n;
+
+	if(nmsgs < 0)
+		return FTDI_I2C_EINVAL;
+	for(m = 0; m < nmsgs; m++) {
+		/* A read must read at least one byte to end with NO ACK */
+		if((msgs[m].flags & FTDI_I2C_M_RD) && msgs[m].len == 0)
+			return FTDI_I2C_EINVAL;
+		if(msgs[m].addr > 0x7F || (msgs[m].len && msgs[m].buf == NULL))
+			return FTDI_I2C_EINVAL;
+	}
+	for(m = 0; m < nmsgs; m++) {
+		HighSpeedSetI2CStart(ctx);	// Repeated start for all but the first message
+		if(ctx->debug)
+			printf("Sending %02X\n", (msgs[m].addr << 1) | (msgs[m].flags & FTDI_I2C_M_RD));
+		QueueByteAndACK(ctx, (msgs[m].addr << 1) | (msgs[m].flags & FTDI_I2C_M_RD), status, 0);
+		if(msgs[m].flags & FTDI_I2C_M_RD) {
+			/* Long reads are split so the FT4232H never holds more than FTDI_I2C_MAX_PENDING_RX bytes */
+			for(i = 0; i < msgs[m].len; i += n) {
+				n = msgs[m].len - i;
+				if(n > FTDI_I2C_MAX_PENDING_RX / 2)
+					n = FTDI_I2C_MAX_PENDING_RX / 2;
+				QueueReadBytes(ctx, msgs[m].buf + i, n, i + n == msgs[m].len, status);
+			}
+		}
+		else {
+			for(i = 0; i < msgs[m].len; i++)
+				QueueByteAndACK(ctx, msgs[m].buf[i], status, 0);
+		}
+		if(m == nmsgs - 1 || (msgs[m].flags & FTDI_I2C_M_STOP))
+			HighSpeedSetI2CStop(ctx);
+	}
+	return 0;
+}
+
+/*
+ | ftdi_i2c_transfer:
+ | Run messages as one pipelined command stream, like Linux I2C_RDWR ioctl.
+ | Read data is written straight to the caller's message buffers.
+ | Mux control writes queued by ftdi_i2c_select() are sent in the same USB transfer.
+ | Return number of messages on success, FTDI_I2C_xxx error code otherwise.
+ */
+int ftdi_i2c_transfer(struct ftdi_i2c_context *ctx, struct ftdi_i2c_msg *msgs, int nmsgs) {
+	int status = 0;
+	int r;
+
+	r = ftdi_i2c_queue(ctx, msgs, nmsgs, &status);
+	if(r < 0)
+		return r;
+	ftdi_i2c_flush(ctx);
+	if(ctx->MuxError) {
+		ctx->MuxError = 0;
+		SetStatus(&status, FTDI_I2C_ENACK);
+	}
+	return (status < 0) ? status : nmsgs;
+}
+
+/*
+ | CheckPort:
+ | Return 0 if the chip has the GPIO port, FTDI_I2C_EINVAL otherwise.
+ */
+static int CheckPort(struct ftdi_i2c_context *ctx, int port) {
+	if(port == FTDI_I2C_GPIOL)
+		return 0;
+	if(port == FTDI_I2C_GPIOH && ctx->ftdic.type == TYPE_2232H)
+		return 0;
+	return FTDI_I2C_EINVAL;
+}
+
+/*
+ | SetGPIO:
+ | Queue set data bits command with the current values and directions of a port.
+ | SCL and SDA are released, the bus is idle between transfers.
+ */
+static void SetGPIO(struct ftdi_i2c_context *ctx, int port) {
+	unsigned char *OutputBuffer = ctx->OutputBuffer;
+
+	Reserve(ctx, 3);
+	if(port == FTDI_I2C_GPIOL) {
+		OutputBuffer[ctx->dwNumBytesToSend++] = '\x80';	// Set data bits low byte
+		OutputBuffer[ctx->dwNumBytesToSend++] = ctx->gpio << 4;
+		OutputBuffer[ctx->dwNumBytesToSend++] = ctx->gpiodir << 4;
+	}
+	else {
+		OutputBuffer[ctx->dwNumBytesToSend++] = '\x82';	// Set data bits high byte
+		OutputBuffer[ctx->dwNumBytesToSend++] = ctx->gpioh;
+		OutputBuffer[ctx->dwNumBytesToSend++] = ctx->gpiohdir;
+	}
+}
+
+/*
+ | ftdi_i2c_queue_gpio_set:
+ | Queue driving the pins in mask to value, between the transfers queued before and after.
+ | For FTDI_I2C_GPIOL bits 0-3 are GPIOL0-3, the new values are used by all later commands.
+ | Return 0 or FTDI_I2C_EINVAL if the chip does not have the port.
+ */
+int ftdi_i2c_queue_gpio_set(struct ftdi_i2c_context *ctx, int port, unsigned char mask, unsigned char value) {
+	if(CheckPort(ctx, port) < 0)
+		return FTDI_I2C_EINVAL;
+	if(port == FTDI_I2C_GPIOL) {
+		mask &= 0x0F;
+		ctx->gpio = (ctx->gpio & ~mask) | (value & mask);
+		ctx->gpiodir |= mask;
+	}
+	else {
+		ctx->gpioh = (ctx->gpioh & ~mask) | (value & mask);
+		ctx->gpiohdir |= mask;
+	}
+	SetGPIO(ctx, port);
+	return 0;
+}
+
+/*
+ | ftdi_i2c_queue_gpio_input:
+ | Queue making the pins in mask inputs.
+ | Return 0 or FTDI_I2C_EINVAL if the chip does not have the port.
+ */
+int ftdi_i2c_queue_gpio_input(struct ftdi_i2c_context *ctx, int port, unsigned char mask) {
+	if(CheckPort(ctx, port) < 0)
+		return FTDI_I2C_EINVAL;
+	if(port == FTDI_I2C_GPIOL)
+		ctx->gpiodir &= ~mask;
+	else
+		ctx->gpiohdir &= ~mask;
+	SetGPIO(ctx, port);
+	return 0;
+}
+
+/*
+ | ftdi_i2c_queue_gpio_get:
+ | Queue reading the pins of a port, *value is set on flush like read data.
+ | For FTDI_I2C_GPIOL bits 0-3 are GPIOL0-3 as in ftdi_i2c_queue_gpio_set(), the others are 0.
+ | Return 0 or FTDI_I2C_EINVAL if the chip does not have the port.
+ */
+int ftdi_i2c_queue_gpio_get(struct ftdi_i2c_context *ctx, int port, unsigned char *value, int *status) {
+	if(CheckPort(ctx, port) < 0)
+		return FTDI_I2C_EINVAL;
+	MakeRoomRx(ctx, 1);
+	Reserve(ctx, 1);
+	ctx->OutputBuffer[ctx->dwNumBytesToSend++] = (port == FTDI_I2C_GPIOL) ? '\x81' : '\x83';	// Read data bits
+	ExpectRx(ctx, value, 1, status, 0);
+	ctx->Segments[ctx->dwNumSegments - 1].gpiol = (port == FTDI_I2C_GPIOL);
+	return 0;
+}
+
+/*
+ | ftdi_i2c_queue_delay:
+ | Queue a pause of us microseconds, timed by the MPSSE clock so it does not depend on
+ | how commands are split into USB transfers.
+ | SCL is released first so the clocks do not reach the bus.
+ | Replies queued after a delay longer than ReadTimeout can't be read, raise it for such delays.
+ */
+void ftdi_i2c_queue_delay(struct ftdi_i2c_context *ctx, unsigned int us) {
+	unsigned char *OutputBuffer = ctx->OutputBuffer;
+	unsigned long long clocks = (unsigned long long)us * 30 / (1 + ctx->dwClockDivisor); // SCL Frequency = 60/((1+dwClockDivisor)*2) (MHz)
+	unsigned int n;
+
+	SetGPIO(ctx, FTDI_I2C_GPIOL);
+	while(clocks >= 8) {
+		n = (clocks / 8 > 0x10000) ? 0x10000 : clocks / 8;
+		Reserve(ctx, 3);
+		OutputBuffer[ctx->dwNumBytesToSend++] = '\x8F';	// Clock for n bytes with no data transfer
+		OutputBuffer[ctx->dwNumBytesToSend++] = (n - 1) & 0xFF;
+		OutputBuffer[ctx->dwNumBytesToSend++] = (n - 1) >> 8;
+		clocks -= n * 8;
+	}
+	if(clocks) {
+		Reserve(ctx, 2);
+		OutputBuffer[ctx->dwNumBytesToSend++] = '\x8E';	// Clock for n bits with no data transfer
+		OutputBuffer[ctx->dwNumBytesToSend++] = clocks - 1;
+	}
+}
+
+/*
+ | ftdi_i2c_write_async:
+ | Queue a write frame without waiting for its ACK bits, for LED drivers, DACs and the like.
+ | Commands go out whenever the command buffer fills, ACK bits pile up in the FT4232H and are
+ | checked as room is needed or by ftdi_i2c_sync(), so frames are sent at bus rate.
+ | Message data is copied, buffers may be reused at once. Reads are not allowed.
+ | Return index of the frame, FTDI_I2C_EINVAL if a message is invalid.
+ */
+long ftdi_i2c_write_async(struct ftdi_i2c_context *ctx, struct ftdi_i2c_msg *msgs, int nmsgs) {
+	int m, r;
+
+	for(m = 0; m < nmsgs; m++) {
+		if(msgs[m].flags & FTDI_I2C_M_RD)
+			return FTDI_I2C_EINVAL;
+	}
+	ctx->QueueFrame = ctx->dwNextFrame;
+	r = ftdi_i2c_queue(ctx, msgs, nmsgs, NULL);
+	ctx->QueueFrame = -1;
+	if(r < 0)
+		return r;
+	return ctx->dwNextFrame++;
+}
+
+/*
+ | ftdi_i2c_sync:
+ | Wait until all queued frames went out and check their ACK bits.
+ | Indexes of frames not acknowledged since the last sync are stored in frames (at most max,
+ | and at most FTDI_I2C_MAX_ASYNC_ERRORS are remembered).
+ | Return number of frames not acknowledged, FTDI_I2C_EIO if a USB error hit frames since the
+ | last sync, also while their replies were read as room was needed, FTDI_I2C_ENACK if a mux
+ | selected by ftdi_i2c_select() did not acknowledge (frames after it may have gone to a device
+ | on another channel).
+ */
+int ftdi_i2c_sync(struct ftdi_i2c_context *ctx, long *frames, int max) {
+	int n;
+
+	if(ftdi_i2c_flush(ctx) < 0 || ctx->AsyncEIO) {
+		/* Frames were lost, we can't tell which */
+		ctx->AsyncEIO = 0;
+		ctx->MuxError = 0;
+		ctx->dwNumAsyncErrors = 0;
+		return FTDI_I2C_EIO;
+	}
+	if(ctx->MuxError) {
+		ctx->MuxError = 0;
+		ctx->dwNumAsyncErrors = 0;
+		return FTDI_I2C_ENACK;
+	}
+	n = ctx->dwNumAsyncErrors;
+	if(max > FTDI_I2C_MAX_ASYNC_ERRORS)
+		max = FTDI_I2C_MAX_ASYNC_ERRORS;
+	if(frames != NULL && max > 0)
+		memcpy(frames, ctx->AsyncErrors, ((n < max) ? n : max) * sizeof(long));
+	ctx->dwNumAsyncErrors = 0;
+	return n;
+}
+
+/*
+ | ftdi_i2c_init:
+ | Initialize context with default settings, call before ftdi_i2c_open().
+ | Fields such as debug, dwClockDivisor, ReadTimeout and ProductId may be changed between the two calls,
+ | ftdi_i2c_trace_open() should be called there too to trace the whole session.
+ */
+int ftdi_i2c_init(struct ftdi_i2c_context *ctx) {
+	memset(ctx, 0, sizeof(*ctx));
+	ctx->dwClockDivisor = 0x0095; // SCL Frequency = 60/((1+0x0095)*2) (MHz) = 200khz
+	ctx->QueueFrame = -1;
+	ctx->ReadTimeout = FTDI_I2C_READ_TIMEOUT;
+	ctx->ProductId = 0x6011;	// FT4232H
+	ctx->gpiodir = 0x0F;	// GPIOL0-3 are outputs
+	if(ftdi_init(&ctx->ftdic) < 0) {
+		printf("ftdi init failed\n");
+		return FTDI_I2C_EIO;
+	}
+	return 0;
+}
+
+/*
+ | ftdi_i2c_open:
+ | Open FT4232 device and get valid handle for subsequent access.
+ | Note that this utility will open the first FT4232 chip found, set ProductId between
+ | ftdi_i2c_init() and ftdi_i2c_open() to use another chip (0x6010 for FT2232H).
+ | chan is 0 for channel A or 1 for channel B, channels C and D of the FT4232H have no MPSSE.
+ | Return 0 on success, FTDI_I2C_EINVAL for another channel, FTDI_I2C_EIO on error.
+ */
+int ftdi_i2c_open(struct ftdi_i2c_context *ctx, int chan, unsigned char gpio) {
+	unsigned char *OutputBuffer = ctx->OutputBuffer;
+	unsigned char *InputBuffer = ctx->InputBuffer;
+	unsigned int dwCount;
+	int dwNumBytesRead = 0;
+	int bCommandEchoed = 0;
+	int ftStatus = 0;
+	int i;
+
+	if(chan != 0 && chan != 1) {
+		printf("Channel %d has no MPSSE, use 0 (A) or 1 (B)\n", chan);
+		return FTDI_I2C_EINVAL;
+	}
+	ctx->chan = chan;
+	ctx->gpio = gpio;
+	i = (chan == 0) ? INTERFACE_A : INTERFACE_B;
+	ftdi_set_interface(&ctx->ftdic, i);
+
+	ftStatus = ftdi_usb_open(&ctx->ftdic, 0x0403, ctx->ProductId);
+	if(ftStatus < 0) {
+		printf("Error opening usb device: %s\n", ftdi_get_error_string(&ctx->ftdic));
+		return FTDI_I2C_EIO;
+	}
+
+	// Port opened successfully
+	if(ctx->debug)
+		printf("Port opened, resetting device...\n");
+
+	ftStatus |= ftdi_usb_reset(&ctx->ftdic); 			// Reset USB device
+	ftStatus |= ftdi_usb_purge_rx_buffer(&ctx->ftdic);	// purge rx buffer
+	ftStatus |= ftdi_usb_purge_tx_buffer(&ctx->ftdic);	// purge tx buffer
+	/* Set MPSSE mode */
+	ftdi_set_bitmode(&ctx->ftdic, 0xFF, BITMODE_RESET);
+	ftdi_set_bitmode(&ctx->ftdic, 0xFF, BITMODE_MPSSE);
+	/*
+	 | Below code will synchronize the MPSSE interface by sending bad command 0xAA
+	 | response should be echo command followed by bad command 0xAA.
+	 | This will make sure the MPSSE interface enabled and synchronized successfully
+	 */
+	OutputBuffer[ctx->dwNumBytesToSend++] = '\xAA'; 	// Add BAD command 0xxAA
+	WriteCommands(ctx);
+	dwNumBytesRead = ReadData(ctx, InputBuffer, 2);	// Waits up to ReadTimeout
+	if(dwNumBytesRead < 0) {
+		if(ctx->debug)
+			printf("Error: %s\n", ftdi_get_error_string(&ctx->ftdic));
+	}
+	else if(ctx->debug)
+		printf("Got %d bytes %02X %02X\n", dwNumBytesRead, InputBuffer[0], InputBuffer[1]);
+	// Check if echo command and bad received
+	for (dwCount = 0; (int)dwCount < dwNumBytesRead - 1; dwCount++) {
+		if ((InputBuffer[dwCount] == 0xFA) && (InputBuffer[dwCount+1] == 0xAA)) {
+			if(ctx->debug)
+				printf("FTDI synchronized\n");
+			bCommandEchoed = 1;
+			break;
+		}
+	}
+	if (bCommandEchoed == 0) {
+		ftdi_usb_close(&ctx->ftdic);
+		return FTDI_I2C_EIO;
+		/* Error, cant receive echo command , fail to synchronize MPSSE interface. */
+	}
+
+	OutputBuffer[ctx->dwNumBytesToSend++] = '\x8A'; //Ensure disable clock divide by 5 for 60Mhz master clock
+	OutputBuffer[ctx->dwNumBytesToSend++] = '\x97';
+	// Ensure turn off adaptive clocking
+	// Enable 3 phase data clock, used by I2C to allow data on both clock edges
+	OutputBuffer[ctx->dwNumBytesToSend++] = '\x8D';
+	OutputBuffer[ctx->dwNumBytesToSend++] = '\x80'; // Command to set directions of lower 8 pins and force value on 	bits set as output
+	OutputBuffer[ctx->dwNumBytesToSend++] = 0x03 | (unsigned char)(gpio << 4) ; // Set SDA, SCL high and set GPIO
+	OutputBuffer[ctx->dwNumBytesToSend++] = '\x03' | (ctx->gpiodir << 4); // Set SK,DO DI and GPIO as outputs
+	// The SK clock frequency can be worked out by below algorithm with divide by 5 set as off
+	// SK frequency = 60MHz /((1 + [(1 +0xValueH*256) OR 0xValueL])*2)
+	OutputBuffer[ctx->dwNumBytesToSend++] = '\x86'; // Command to set clock divisor
+	OutputBuffer[ctx->dwNumBytesToSend++] = ctx->dwClockDivisor & '\xFF'; //Set 0xValueL of clock divisor
+	OutputBuffer[ctx->dwNumBytesToSend++] = (ctx->dwClockDivisor >> 8) & '\xFF';
+	// Set ValueH of clock divisor
+	OutputBuffer[ctx->dwNumBytesToSend++] = '\x85'; // Turn off loop back in case
+	//Command to turn off loop back of TDI/TDO connection
+	return WriteCommands(ctx);
+}
+
+/*
+ | ftdi_i2c_close:
+ | Close the muxes opened through this context, send whatever is still queued and close the FT4232 device.
+ | The next program using the bus assumes all muxes are closed.
+ */
+void ftdi_i2c_close(struct ftdi_i2c_context *ctx) {
+	struct i2c_path none;
+
+	memset(&none, 0, sizeof(none));
+	ftdi_i2c_queue_select(ctx, &none, NULL);	// A path with no muxes closes every open level
+	ftdi_i2c_flush(ctx);
+	ftdi_i2c_trace_close(ctx);
+	ftdi_usb_close(&ctx->ftdic);
+	ftdi_deinit(&ctx->ftdic);
+}
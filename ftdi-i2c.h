@@ -0,0 +1,123 @@
+/*
+ | libftdi-i2c: I2C master using libftdi and FT4232 chip connected to USB.
+ |
+ | Written by Ori Idan, Helicon technologies LTD. (ori@helicontech.co.il)
+ |
+ | libftdi-i2c is free software: you can redistribute it and/or modify it
+ | under the terms of the GNU General Public License as published by the
+ | Free Software Foundation, either version 3 of the License, or
+ | (at your option) any later version.
+ |
+ | libftdi-i2c is distributed in the hope that it will be useful, but
+ | WITHOUT ANY WARRANTY; without even the implied warranty of
+ | MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ | See the GNU General Public License for more details.
+ |
+ | You should have received a copy of the GNU General Public License along
+ | with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef FTDI_I2C_H
+#define FTDI_I2C_H
+
+#include <ftdi.h>
+#include "i2cmux.h"
+
+/*
+ | Error codes returned by the library
+ */
+#define FTDI_I2C_EIO (-1)	// USB error
+#define FTDI_I2C_ENACK (-2)	// Address or data byte not acknowledged
+#define FTDI_I2C_EINVAL (-3)	// Invalid argument
+
+/*
+ | Message flags
+ */
+#define FTDI_I2C_M_RD 0x0001	// Read data from device to buf
+#define FTDI_I2C_M_STOP 0x8000	// Send stop condition after this message
+
+/*
+ | GPIO ports
+ */
+#define FTDI_I2C_GPIOL 0	// GPIOL0-3 as bits 0-3 (bits 4-7 of the low byte, next to SCL/SDA)
+#define FTDI_I2C_GPIOH 1	// High byte, FT2232H only (the FT4232H has none)
+
+#define FTDI_I2C_OUTPUT_SIZE 16384	// Size of MPSSE command buffer
+#define FTDI_I2C_MAX_PENDING_RX 1024	// Maximum bytes expected from FT4232H before they are read
+#define FTDI_I2C_READ_TIMEOUT 5000	// Default ms without replies from FT4232H before a read fails
+#define FTDI_I2C_MAX_ASYNC_ERRORS 64	// Not acknowledged frames listed by ftdi_i2c_sync()
+
+/*
+ | One message of a transfer, like struct i2c_msg of Linux I2C_RDWR.
+ | Messages of a transfer are separated by repeated start, a stop is sent after the last one
+ | and after messages with FTDI_I2C_M_STOP.
+ */
+struct ftdi_i2c_msg {
+	unsigned char addr;	// 7 bit device address
+	unsigned short flags;	// FTDI_I2C_M_xxx
+	unsigned short len;	// Number of bytes to read or write
+	unsigned char *buf;	// Caller owned data buffer
+};
+
+/*
+ | Bytes the FT4232H will send back for queued commands.
+ | buf is NULL for ACK bits, these are checked and the result stored in status.
+ */
+struct ftdi_i2c_segment {
+	unsigned char *buf;	// Where read data goes, NULL for ACK bits
+	unsigned int len;
+	int *status;	// Result of the transfer owning this segment, may be NULL
+	int mux;	// ACK bits of mux control writes
+	long frame;	// Fire-and-forget frame owning these ACK bits, -1 if none
+	int gpiol;	// Low byte pins read, GPIOL0-3 are moved to bits 0-3
+};
+
+/*
+ | Context holding everything that used to be global in i2csend and i2cget.
+ | Commands are queued in OutputBuffer and sent by ftdi_i2c_flush().
+ */
+struct ftdi_i2c_context {
+	struct ftdi_context ftdic;
+	int ProductId;	// USB product ID of the chip to open, 0x6011 (FT4232H) by default
+	unsigned char OutputBuffer[FTDI_I2C_OUTPUT_SIZE]; // Buffer to hold MPSSE commands and data to be sent to FT4232H
+	unsigned char InputBuffer[FTDI_I2C_MAX_PENDING_RX];  // Buffer to hold ACK bits read from FT4232H
+	unsigned int dwClockDivisor; // Value of clock divisor, SCL Frequency = 60/((1+dwClockDivisor)*2) (MHz)
+	unsigned int dwNumBytesToSend; // Index of output buffer
+	struct ftdi_i2c_segment Segments[FTDI_I2C_MAX_PENDING_RX];
+	unsigned int dwNumSegments;
+	unsigned int dwNumRxPending; // Bytes expected from FT4232H and not read yet
+	struct i2c_mux_state mux;
+	int MuxError;	// A mux control write of ftdi_i2c_select() failed since the last transfer or sync
+	long QueueFrame;	// Frame being queued by ftdi_i2c_write_async(), -1 otherwise
+	long dwNextFrame;	// Index of next fire-and-forget frame
+	long AsyncErrors[FTDI_I2C_MAX_ASYNC_ERRORS];	// Frames not acknowledged since the last ftdi_i2c_sync()
+	unsigned int dwNumAsyncErrors;
+	long LastAsyncError;
+	int AsyncEIO;	// A USB error hit fire-and-forget frames since the last ftdi_i2c_sync()
+	int chan;
+	unsigned char gpio;	// GPIOL0-3 output values
+	unsigned char gpiodir;	// GPIOL0-3 driven as outputs, others are inputs
+	unsigned char gpioh, gpiohdir;	// High byte values and outputs
+	int debug;	// Debug mode
+	unsigned int ReadTimeout;	// ms without replies from FT4232H before a read fails
+	int TraceFd;	// Trace file, see ftdi-i2c-trace.h
+	unsigned char *TraceBuffer;	// Records not written yet, NULL if not tracing
+	unsigned int dwTraceBytes;
+};
+
+int ftdi_i2c_init(struct ftdi_i2c_context *ctx);
+int ftdi_i2c_open(struct ftdi_i2c_context *ctx, int chan, unsigned char gpio);
+void ftdi_i2c_close(struct ftdi_i2c_context *ctx);
+void ftdi_i2c_select(struct ftdi_i2c_context *ctx, const struct i2c_path *path);
+int ftdi_i2c_queue_select(struct ftdi_i2c_context *ctx, const struct i2c_path *path, int *status);
+int ftdi_i2c_queue(struct ftdi_i2c_context *ctx, struct ftdi_i2c_msg *msgs, int nmsgs, int *status);
+int ftdi_i2c_flush(struct ftdi_i2c_context *ctx);
+int ftdi_i2c_transfer(struct ftdi_i2c_context *ctx, struct ftdi_i2c_msg *msgs, int nmsgs);
+int ftdi_i2c_queue_gpio_set(struct ftdi_i2c_context *ctx, int port, unsigned char mask, unsigned char value);
+int ftdi_i2c_queue_gpio_input(struct ftdi_i2c_context *ctx, int port, unsigned char mask);
+int ftdi_i2c_queue_gpio_get(struct ftdi_i2c_context *ctx, int port, unsigned char *value, int *status);
+void ftdi_i2c_queue_delay(struct ftdi_i2c_context *ctx, unsigned int us);
+long ftdi_i2c_write_async(struct ftdi_i2c_context *ctx, struct ftdi_i2c_msg *msgs, int nmsgs);
+int ftdi_i2c_sync(struct ftdi_i2c_context *ctx, long *frames, int max);
+unsigned long long ftdi_i2c_time(void);
+
+#endif
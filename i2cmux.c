@@ -0,0 +1,152 @@
+/*
+ | I2C multiplexer (PCA9548/TCA9548) device path handling.
+ | Parses device paths and keeps track of the channel currently selected on each mux
+ | so that redundant select writes are not sent.
+ |
+ | Written by Ori Idan, Helicon technologies LTD. (ori@helicontech.co.il)
+ |
+ | This file is free software: you can redistribute it and/or modify it
+ | under the terms of the GNU General Public License as published by the
+ | Free Software Foundation, either version 3 of the License, or
+ | (at your option) any later version.
+ |
+ | This file is distributed in the hope that it will be useful, but
+ | WITHOUT ANY WARRANTY; without even the implied warranty of
+ | MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ | See the GNU General Public License for more details.
+ |
+ | You should have received a copy of the GNU General Public License along
+ | with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <ctype.h>
+#include <string.h>
+#include "i2cmux.h"
+
+/*
+ | ParseHex:
+ | Parse hex value with optional 0x prefix, stop at end of string or '/'.
+ | Return value or -1 if invalid.
+ */
+static int ParseHex(const char **ps) {
+	const char *s = *ps;
+	int b = 0;
+
+	if(*s == '0' && (s[1] == 'x' || s[1] == 'X'))
+		s += 2;
+	if(!isxdigit(*s))
+		return -1;
+	while(*s && *s != '/') {
+		if(!isxdigit(*s))
+			return -1;
+		b *= 16;
+		if(toupper(*s) >= 'A')
+			b += (toupper(*s) - 'A' + 10);
+		else
+			b += (*s - '0');
+		if(b > 0x7F)
+			return -1;	/* Not a 7 bit address */
+		s++;
+	}
+	*ps = s;
+	return b;
+}
+
+/*
+ | ParseI2CPath:
+ | Parse device path such as 0x48, mux@0x70/ch3/0x48 or mux@0x70/ch3/mux@0x74/ch0/0x48
+ | Return 0 on success, -1 on error.
+ */
+int ParseI2CPath(const char *s, struct i2c_path *path) {
+	int b;
+
+	memset(path, 0, sizeof(*path));
+	while(strncmp(s, "mux@", 4) == 0) {
+		if(path->nmux == I2C_MAX_MUX_DEPTH) {
+			printf("Too many muxes in path\n");
+			return -1;
+		}
+		s += 4;
+		b = ParseHex(&s);
+		if(b < 0 || strncmp(s, "/ch", 3) != 0 || s[3] < '0' || s[3] > '7' || s[4] != '/') {
+			printf("Invalid mux in device path\n");
+			return -1;
+		}
+		path->mux[path->nmux] = b;
+		path->chan[path->nmux] = s[3] - '0';
+		path->nmux++;
+		s += 5;
+	}
+	b = ParseHex(&s);
+	if(b < 0 || *s) {
+		printf("Invalid device address\n");
+		return -1;
+	}
+	path->addr = b;
+	return 0;
+}
+
+/*
+ | CloseFrom:
+ | Queue writes closing the open muxes from level down, deepest first while they are
+ | still reachable, and forget them.
+ | Return number of writes stored in writes.
+ */
+static int CloseFrom(struct i2c_mux_state *state, int level, struct i2c_mux_write *writes) {
+	int i;
+	int n = 0;
+
+	for(i = I2C_MAX_MUX_DEPTH - 1; i >= level; i--) {
+		if(!state->level[i].valid)
+			continue;
+		writes[n].mux = state->level[i].mux;
+		writes[n++].value = 0;
+		state->level[i].valid = 0;
+	}
+	return n;
+}
+
+/*
+ | MuxPlanSelect:
+ | Compute the mux control writes needed to connect the device in path to the bus.
+ | Writes already in effect (according to the mux state) are skipped.
+ | Before a channel changes, the muxes open behind it are closed so they are not connected
+ | again when the channel is selected later, and a mux at the same level that has another
+ | channel open is disconnected, so identical devices behind different muxes won't collide.
+ | The mux state is updated as if all writes succeeded, call MuxInvalidate() if one of them fails.
+ | Return number of writes stored in writes (up to I2C_MAX_MUX_WRITES).
+ */
+int MuxPlanSelect(struct i2c_mux_state *state, const struct i2c_path *path, struct i2c_mux_write *writes) {
+	int level;
+	int n = 0;
+
+	for(level = 0; level < path->nmux; level++) {
+		if(state->level[level].valid && state->level[level].mux == path->mux[level] &&
+				state->level[level].chan == path->chan[level])
+			continue;	/* Already selected */
+		n += CloseFrom(state, level + 1, writes + n);
+		if(state->level[level].valid && state->level[level].mux != path->mux[level]) {
+			writes[n].mux = state->level[level].mux;
+			writes[n++].value = 0;
+		}
+		writes[n].mux = path->mux[level];
+		writes[n++].value = 1 << path->chan[level];
+		state->level[level].valid = 1;
+		state->level[level].mux = path->mux[level];
+		state->level[level].chan = path->chan[level];
+	}
+	/* Close muxes still open below the device so devices behind them won't answer as well */
+	n += CloseFrom(state, level, writes + n);
+	return n;
+}
+
+/*
+ | MuxInvalidate:
+ | Forget the state of all muxes, next access will write them again.
+ */
+void MuxInvalidate(struct i2c_mux_state *state) {
+	int i;
+
+	for(i = 0; i < I2C_MAX_MUX_DEPTH; i++)
+		state->level[i].valid = 0;
+}
@@ -0,0 +1,65 @@
+/*
+ | I2C multiplexer (PCA9548/TCA9548) device path handling.
+ |
+ | Written by Ori Idan, Helicon technologies LTD. (ori@helicontech.co.il)
+ |
+ | This file is free software: you can redistribute it and/or modify it
+ | under the terms of the GNU General Public License as published by the
+ | Free Software Foundation, either version 3 of the License, or
+ | (at your option) any later version.
+ |
+ | This file is distributed in the hope that it will be useful, but
+ | WITHOUT ANY WARRANTY; without even the implied warranty of
+ | MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ | See the GNU General Public License for more details.
+ |
+ | You should have received a copy of the GNU General Public License along
+ | with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef I2CMUX_H
+#define I2CMUX_H
+
+#define I2C_MAX_MUX_DEPTH 4	// Maximum number of cascaded muxes in a device path
+#define I2C_MAX_MUX_WRITES (2 * I2C_MAX_MUX_DEPTH + 1)	// Maximum mux control writes needed to reach a device
+
+/*
+ | Device path: a chain of mux channels followed by the device address.
+ | For example mux@0x70/ch3/0x48 is device 0x48 behind channel 3 of the mux at 0x70.
+ | A plain address (0x48) is a path with no muxes.
+ | All addresses are 7 bit (not shifted).
+ */
+struct i2c_path {
+	int nmux;	// Number of muxes in path
+	unsigned char mux[I2C_MAX_MUX_DEPTH];	// Mux addresses, the one closest to the FTDI first
+	unsigned char chan[I2C_MAX_MUX_DEPTH];	// Channel (0-7) to select on each mux
+	unsigned char addr;	// Device address
+};
+
+/*
+ | A single write to a mux control register.
+ | value is the channel mask, 0 means all channels disconnected.
+ */
+struct i2c_mux_write {
+	unsigned char mux;
+	unsigned char value;
+};
+
+/*
+ | Channel currently selected on each level of the mux tree.
+ | Nothing is known after MuxInvalidate(), so the first access always writes the muxes.
+ | The first access assumes muxes not on its path are closed, ftdi_i2c_close() closes
+ | the ones it opened. Muxes forgotten after a failed write are left as they are.
+ */
+struct i2c_mux_state {
+	struct {
+		int valid;
+		unsigned char mux;
+		unsigned char chan;
+	} level[I2C_MAX_MUX_DEPTH];
+};
+
+int ParseI2CPath(const char *s, struct i2c_path *path);
+int MuxPlanSelect(struct i2c_mux_state *state, const struct i2c_path *path, struct i2c_mux_write *writes);
+void MuxInvalidate(struct i2c_mux_state *state);
+
+#endif
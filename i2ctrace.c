@@ -0,0 +1,453 @@
+/*
+ | i2ctrace: decode and replay MPSSE traces recorded by libftdi-i2c (i2cget/i2csend -t).
+ |
+ | decode prints the I2C events (START, address, data, ACK/NACK, STOP) found in the command
+ | stream together with the ACK bits and data the FT4232H sent back, and the time of each
+ | transaction.
+ | replay runs the command stream against a simulated FT4232H and device that answer what
+ | was recorded, and compares the recorded time with the time the bus itself needs.
+ | Run it on traces taken before and after a change to compare performance.
+ |
+ | Written by Ori Idan, Helicon technologies LTD. (ori@helicontech.co.il)
+ |
+ | i2ctrace is free software: you can redistribute it and/or modify it
+ | under the terms of the GNU General Public License as published by the
+ | Free Software Foundation, either version 3 of the License, or
+ | (at your option) any later version.
+ |
+ | i2ctrace is distributed in the hope that it will be useful, but
+ | WITHOUT ANY WARRANTY; without even the implied warranty of
+ | MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ | See the GNU General Public License for more details.
+ |
+ | You should have received a copy of the GNU General Public License along
+ | with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "ftdi-i2c-trace.h"
+
+#define PIN_WRITE_NS 150	// Time of one set pins command, 4 of them make the 600ns I2C setup/hold times
+
+/*
+ | One recorded USB write or read
+ */
+struct record {
+	unsigned char type;
+	unsigned int len;
+	unsigned long long start_ns;
+	unsigned long duration_us;
+	unsigned char *data;
+};
+
+/*
+ | Simulated FT4232H and I2C bus state
+ */
+struct engine {
+	int decode;	// Print I2C events
+	double sck_ns;	// Length of one SCL clock
+	int fixedclock;	// Clock divisor given with -d, the recorded ones are ignored
+	int sda, scl;	// Line state
+	unsigned char gpio, gpiodir;	// GPIOL pins
+	int intrans;	// Inside transaction (after START, before STOP)
+	int first;	// Next byte out is the address
+	int readpending;	// Data byte read, waiting for master ACK/NACK
+	int readbyte;
+	int outpending;	// Byte written, waiting for the ACK bit scan
+	unsigned char outbyte;
+	unsigned char *rx;	// ACK bits and data sent back by FT4232H, from all 'R' records
+	unsigned long long *rxtime;	// Time each rx byte was received
+	unsigned int rxlen, rxpos;
+	unsigned long long base_ns;	// Start time of first record
+	unsigned long long now_ns;	// Time of current command, estimated from bus time inside the record
+	unsigned long long rec_start, rec_end;	// Current record
+	double bus_ns;	// Simulated bus time
+	double trans_bus_ns;
+	unsigned long long trans_start, trans_end;
+	int ntrans;
+	double total_trans_ns, total_trans_bus_ns, max_trans_ns;
+	int rxmissing;	// Bytes expected by the command stream but not recorded
+};
+
+static unsigned long Get32(const unsigned char *p) {
+	return p[0] | (p[1] << 8) | ((unsigned long)p[2] << 16) | ((unsigned long)p[3] << 24);
+}
+
+static unsigned long long Get64(const unsigned char *p) {
+	return Get32(p) | ((unsigned long long)Get32(p + 4) << 32);
+}
+
+/*
+ | LoadTrace:
+ | Read trace file to memory and split it to records.
+ | Return number of records or -1 on error.
+ */
+static int LoadTrace(const char *filename, unsigned char **file, struct record **records, unsigned int *divisor) {
+	FILE *f;
+	long size, pos;
+	int n = 0, max = 0;
+	struct record *r;
+
+	f = fopen(filename, "rb");
+	if(f == NULL) {
+		printf("Can't open %s\n", filename);
+		return -1;
+	}
+	fseek(f, 0, SEEK_END);
+	size = ftell(f);
+	rewind(f);
+	*file = malloc(size);
+	if(*file == NULL || fread(*file, 1, size, f) != (size_t)size || size < FTDI_I2C_TRACE_HEADER_SIZE ||
+			memcmp(*file, FTDI_I2C_TRACE_MAGIC, 8) != 0) {
+		printf("%s is not a trace file\n", filename);
+		fclose(f);
+		return -1;
+	}
+	fclose(f);
+	*divisor = Get32(*file + 8);
+	*records = NULL;
+	for(pos = FTDI_I2C_TRACE_HEADER_SIZE; pos + FTDI_I2C_TRACE_RECORD_SIZE <= size; ) {
+		if(n == max) {
+			max = max ? max * 2 : 1024;
+			*records = realloc(*records, max * sizeof(struct record));
+		}
+		r = &(*records)[n];
+		r->type = (*file)[pos];
+		r->len = Get32(*file + pos + 4);
+		r->start_ns = Get64(*file + pos + 8);
+		r->duration_us = Get32(*file + pos + 16);
+		r->data = *file + pos + FTDI_I2C_TRACE_RECORD_SIZE;
+		if(pos + FTDI_I2C_TRACE_RECORD_SIZE + r->len > size)
+			break;
+		pos += FTDI_I2C_TRACE_RECORD_SIZE + r->len;
+		n++;
+	}
+	if(pos != size)
+		printf("%s: trace truncated, last record ignored\n", filename);
+	return n;
+}
+
+/*
+ | ClockNs:
+ | Length of one SCL clock in ns, SCL Frequency = 60/((1+divisor)*2) (MHz)
+ */
+static double ClockNs(unsigned int divisor) {
+	return 1000.0 * (1 + divisor) * 2 / 60;
+}
+
+/*
+ | EventTime:
+ | Time of current event in seconds since start of trace.
+ */
+static double EventTime(struct engine *e) {
+	return (e->now_ns - e->base_ns) / 1e9;
+}
+
+/*
+ | RxByte:
+ | Next byte sent back by the FT4232H, -1 if the trace has no more.
+ */
+static int RxByte(struct engine *e) {
+	if(e->rxpos >= e->rxlen) {
+		e->rxmissing++;
+		return -1;
+	}
+	if(e->intrans && e->rxtime[e->rxpos] > e->trans_end)
+		e->trans_end = e->rxtime[e->rxpos];
+	return e->rx[e->rxpos++];
+}
+
+/*
+ | ByteOut:
+ | Print byte written to the bus with the ACK bit, ack is -1 if not in trace, -2 if not scanned.
+ */
+static void ByteOut(struct engine *e, int ack) {
+	e->outpending = 0;
+	if(!e->decode)
+		return;
+	if(e->first)
+		printf("%12.6f ADDR  0x%02X %c", EventTime(e), e->outbyte >> 1, (e->outbyte & 1) ? 'R' : 'W');
+	else
+		printf("%12.6f WRITE 0x%02X", EventTime(e), e->outbyte);
+	if(ack == -1)
+		printf(" ?? (ACK not in trace)\n");
+	else if(ack == -2)
+		printf("\n");
+	else
+		printf(" %s\n", (ack & 0x01) ? "NACK" : "ACK");
+}
+
+/*
+ | SetPins:
+ | Handle set data bits low byte command, detect START, STOP and master ACK.
+ */
+static void SetPins(struct engine *e, unsigned char value, unsigned char dir) {
+	int sda = (dir & 0x02) ? ((value >> 1) & 1) : 1;	// Released lines are pulled high
+	int scl = (dir & 0x01) ? (value & 1) : 1;
+
+	if(e->decode && ((value & dir & 0xF0) != (e->gpio & e->gpiodir & 0xF0) || (dir & 0xF0) != (e->gpiodir & 0xF0)))
+		printf("%12.6f GPIOL %X (dir %X)\n", EventTime(e), (value >> 4) & 0x0F, (dir >> 4) & 0x0F);
+	e->gpio = value;
+	e->gpiodir = dir;
+	if(e->outpending && e->scl && scl && e->sda != sda)
+		ByteOut(e, -2);
+	if(e->scl && scl && e->sda && !sda) {
+		if(e->decode)
+			printf("%12.6f %s\n", EventTime(e), e->intrans ? "RESTART" : "START");
+		if(!e->intrans) {
+			e->intrans = 1;
+			e->trans_start = e->rec_start;
+			e->trans_end = e->rec_end;
+			e->trans_bus_ns = e->bus_ns;
+		}
+		e->first = 1;
+	}
+	else if(e->scl && scl && !e->sda && sda && e->intrans) {
+		double rec, bus;
+
+		e->intrans = 0;
+		if(e->rec_end > e->trans_end)
+			e->trans_end = e->rec_end;
+		rec = e->trans_end - e->trans_start;
+		bus = e->bus_ns - e->trans_bus_ns;
+		e->ntrans++;
+		e->total_trans_ns += rec;
+		e->total_trans_bus_ns += bus;
+		if(rec > e->max_trans_ns)
+			e->max_trans_ns = rec;
+		if(e->decode)
+			printf("%12.6f STOP  transaction %d: %.0f us recorded, %.0f us on bus\n", EventTime(e), e->ntrans, rec / 1000, bus / 1000);
+	}
+	else if(!e->scl && scl && e->readpending) {
+		/* Master drives SDA while clocking the 9th bit of a read byte */
+		if(e->decode) {
+			if(e->readbyte < 0)
+				printf("%12.6f READ  ?? (not in trace) %s\n", EventTime(e), sda ? "NACK" : "ACK");
+			else
+				printf("%12.6f READ  0x%02X %s\n", EventTime(e), e->readbyte, sda ? "NACK" : "ACK");
+		}
+		e->readpending = 0;
+	}
+	e->sda = sda;
+	e->scl = scl;
+}
+
+/*
+ | Run:
+ | Feed the commands of one 'W' record to the simulated FT4232H.
+ */
+static void Run(struct engine *e, const struct record *r) {
+	const unsigned char *p = r->data;
+	unsigned int i = 0;
+	unsigned int len, n;
+	int b, ack;
+	double start = e->bus_ns;
+
+	e->rec_start = r->start_ns;
+	e->rec_end = r->start_ns + r->duration_us * 1000ULL;
+
+	while(i < r->len) {
+		e->now_ns = r->start_ns + (unsigned long long)(e->bus_ns - start);	// Commands of a record run one after the other
+		switch(p[i]) {
+		case 0x80:	// Set data bits low byte
+		case 0x82:	// Set data bits high byte
+			if(i + 3 > r->len)
+				goto truncated;
+			if(p[i] == 0x80)
+				SetPins(e, p[i + 1], p[i + 2]);
+			else if(e->decode)
+				printf("%12.6f GPIOH %02X (dir %02X)\n", EventTime(e), p[i + 1], p[i + 2]);
+			e->bus_ns += PIN_WRITE_NS;
+			i += 3;
+			break;
+		case 0x81:	// Read data bits low byte
+		case 0x83:	// Read data bits high byte
+			b = RxByte(e);
+			if(e->decode)
+				printf("%12.6f GPIO%c read %02X\n", EventTime(e), p[i] == 0x81 ? 'L' : 'H', b & 0xFF);
+			i += 1;
+			break;
+		case 0x11:	// Clock bytes out on -ve edge MSB first
+			if(i + 3 > r->len)
+				goto truncated;
+			len = p[i + 1] + (p[i + 2] << 8) + 1;
+			if(i + 3 + len > r->len)
+				goto truncated;
+			for(n = 0; n < len; n++) {
+				if(e->outpending) {
+					ByteOut(e, -2);
+					e->first = 0;
+				}
+				e->outbyte = p[i + 3 + n];
+				e->outpending = 1;
+			}
+			e->bus_ns += len * 8 * e->sck_ns;
+			i += 3 + len;
+			break;
+		case 0x22:	// Clock bits in on +ve edge MSB first
+			if(i + 2 > r->len)
+				goto truncated;
+			ack = RxByte(e);
+			if(e->outpending) {	// ACK bit of the byte written
+				ByteOut(e, ack);
+				e->first = 0;
+			}
+			e->bus_ns += (p[i + 1] + 1) * e->sck_ns;
+			i += 2;
+			break;
+		case 0x24:	// Clock bytes in on -ve edge MSB first
+			if(i + 3 > r->len)
+				goto truncated;
+			len = p[i + 1] + (p[i + 2] << 8) + 1;
+			for(n = 0; n < len; n++)
+				e->readbyte = RxByte(e);
+			e->readpending = 1;
+			e->bus_ns += len * 8 * e->sck_ns;
+			i += 3;
+			break;
+		case 0x8E:	// Clock bits, no data
+			if(i + 2 > r->len)
+				goto truncated;
+			e->bus_ns += (p[i + 1] + 1) * e->sck_ns;
+			i += 2;
+			break;
+		case 0x8F:	// Clock bytes, no data
+			if(i + 3 > r->len)
+				goto truncated;
+			e->bus_ns += (p[i + 1] + (p[i + 2] << 8) + 1) * 8 * e->sck_ns;
+			i += 3;
+			break;
+		case 0x86:	// Set clock divisor
+			if(i + 3 > r->len)
+				goto truncated;
+			/* The divisor may have been changed after the trace was opened, time the bus at this one */
+			if(!e->fixedclock) {
+				e->sck_ns = ClockNs(p[i + 1] | (p[i + 2] << 8));
+				if(e->decode)
+					printf("%12.6f SCL %.1f kHz\n", EventTime(e), 1e6 / e->sck_ns);
+			}
+			i += 3;
+			break;
+		case 0x84: case 0x85: case 0x87: case 0x8A: case 0x8B: case 0x8C: case 0x8D: case 0x96: case 0x97:
+			i += 1;
+			break;
+		default:	// Bad command, FT4232H answers 0xFA and the command
+			RxByte(e);
+			b = RxByte(e);
+			if(e->decode)
+				printf("%12.6f BAD COMMAND %02X (answer %02X)\n", EventTime(e), p[i], b & 0xFF);
+			i += 1;
+			break;
+		}
+	}
+	return;
+truncated:
+	printf("Command %02X truncated\n", p[i]);
+}
+
+/*
+ | Process:
+ | Decode or replay one trace file.
+ | The bus is timed at divisor if it is not -1, otherwise at the divisor set in the trace.
+ */
+static int Process(const char *filename, int decode, long divisor) {
+	unsigned char *file;
+	struct record *records;
+	struct engine e;
+	unsigned int filedivisor;
+	unsigned long nw = 0, nr = 0, bw = 0, br = 0, roundtrips = 0;
+	unsigned long long end = 0;
+	int n, i;
+	unsigned int j;
+
+	n = LoadTrace(filename, &file, &records, &filedivisor);
+	if(n < 0)
+		return 1;
+	memset(&e, 0, sizeof(e));
+	e.decode = decode;
+	e.fixedclock = (divisor >= 0);
+	e.sck_ns = ClockNs(e.fixedclock ? divisor : filedivisor);
+	e.sda = e.scl = 1;
+	/* Collect everything the FT4232H sent back, in order */
+	for(i = 0; i < n; i++) {
+		if(records[i].type == FTDI_I2C_TRACE_READ)
+			e.rxlen += records[i].len;
+	}
+	e.rx = malloc(e.rxlen + 1);
+	e.rxtime = malloc((e.rxlen + 1) * sizeof(unsigned long long));
+	e.rxlen = 0;
+	for(i = 0; i < n; i++) {
+		if(records[i].type != FTDI_I2C_TRACE_READ)
+			continue;
+		for(j = 0; j < records[i].len; j++) {
+			e.rx[e.rxlen] = records[i].data[j];
+			e.rxtime[e.rxlen++] = records[i].start_ns + records[i].duration_us * 1000ULL;
+		}
+	}
+	if(n)
+		e.base_ns = records[0].start_ns;
+
+	for(i = 0; i < n; i++) {
+		if(records[i].start_ns + records[i].duration_us * 1000ULL > end)
+			end = records[i].start_ns + records[i].duration_us * 1000ULL;
+		if(records[i].type == FTDI_I2C_TRACE_WRITE) {
+			nw++;
+			bw += records[i].len;
+			Run(&e, &records[i]);
+			/* A write followed by a read is one round trip */
+			if(i + 1 < n && records[i + 1].type == FTDI_I2C_TRACE_READ)
+				roundtrips++;
+		}
+		else {
+			nr++;
+			br += records[i].len;
+		}
+	}
+
+	if(!decode || e.rxmissing)
+		printf("%s:\n", filename);
+	if(!decode) {
+		printf("  SCL: %.1f kHz\n", 1e6 / e.sck_ns);
+		printf("  USB: %lu writes (%lu bytes), %lu reads (%lu bytes), %lu round trips\n", nw, bw, nr, br, roundtrips);
+		printf("  Recorded time: %.0f us, time on bus: %.0f us (%.1f%%)\n", (end - e.base_ns) / 1000.0, e.bus_ns / 1000,
+			(end > e.base_ns) ? 100.0 * e.bus_ns / (end - e.base_ns) : 0.0);
+		printf("  Transactions: %d", e.ntrans);
+		if(e.ntrans)
+			printf(", average %.0f us recorded, %.0f us on bus, max %.0f us recorded",
+				e.total_trans_ns / e.ntrans / 1000, e.total_trans_bus_ns / e.ntrans / 1000, e.max_trans_ns / 1000);
+		printf("\n");
+	}
+	if(e.rxmissing)
+		printf("  %d bytes expected from the FT4232H are missing in the trace\n", e.rxmissing);
+	else if(e.rxpos != e.rxlen)
+		printf("  %u bytes recorded from the FT4232H were not expected by the commands\n", e.rxlen - e.rxpos);
+	free(e.rx);
+	free(e.rxtime);
+	free(records);
+	free(file);
+	return 0;
+}
+
+int main(int argc, char *argv[]) {
+	long divisor = -1;
+	int a = 2;
+	int r = 0;
+
+	if(argc < 3 || (strcmp(argv[1], "decode") != 0 && strcmp(argv[1], "replay") != 0)) {
+		printf("i2ctrace: decode and replay MPSSE traces recorded with -t\n");
+		printf("Written by: Ori Idan Helicon technologies ltd. (ori@helicontech.co.il)\n\n");
+		printf("usage: i2ctrace decode <trace file>\n");
+		printf("       i2ctrace replay [-d <clock divisor>] <trace file> [<trace file>...]\n");
+		return 1;
+	}
+	if(strcmp(argv[1], "decode") == 0)
+		return Process(argv[2], 1, -1);
+	if(strcmp(argv[a], "-d") == 0 && a + 1 < argc) {
+		divisor = strtol(argv[a + 1], NULL, 0);	// Replay at another SCL frequency
+		a += 2;
+	}
+	for( ; a < argc; a++)
+		r |= Process(argv[a], 0, divisor);
+	return r;
+}
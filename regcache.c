@@ -0,0 +1,300 @@
+/*
+ | Register shadow cache for read-mostly device registers.
+ | Registers that never change unless written by us (IDs, calibration constants, configuration)
+ | are kept in a cache file shared by i2cget and i2csend, so reading them again does not touch USB.
+ |
+ | Each line of the cache file declares one register:
+ |   <device> <register> <ttl in seconds | wt> [<value> <time> <hits> <misses>]
+ | For example: mux@0x70/ch3/0x48 0x0F wt
+ | The value, the time it was read and the hit/miss counters are filled in by the utilities.
+ | Registers with a ttl are read again once the ttl expired and are invalidated by writes.
+ | Write-through (wt) registers never expire, writes update the cached value.
+ |
+ | Written by Ori Idan, Helicon technologies LTD. (ori@helicontech.co.il)
+ |
+ | This file is free software: you can redistribute it and/or modify it
+ | under the terms of the GNU General Public License as published by the
+ | Free Software Foundation, either version 3 of the License, or
+ | (at your option) any later version.
+ |
+ | This file is distributed in the hope that it will be useful, but
+ | WITHOUT ANY WARRANTY; without even the implied warranty of
+ | MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ | See the GNU General Public License for more details.
+ |
+ | You should have received a copy of the GNU General Public License along
+ | with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include "regcache.h"
+
+/*
+ | Lines of the cache file in order, comments and lines we can't use are written back unchanged.
+ */
+struct reg_cache_line {
+	char *text;	// Line as read, used when entry is -1
+	int entry;	// Index in RegCache
+};
+
+static struct reg_cache_entry RegCache[REG_CACHE_MAX_ENTRIES];
+static int RegCacheEntries = 0;
+static struct reg_cache_line RegCacheLines[REG_CACHE_MAX_LINES];
+static int RegCacheNumLines = 0;
+static int RegCacheKeepFile = 0;	// File too long to keep all its lines, don't rewrite it
+static FILE *RegCacheFile = NULL;
+
+/*
+ | ParseNumber:
+ | Convert whole string s to a number between min and max.
+ | Return 0 on success, -1 if s is not such a number.
+ */
+static int ParseNumber(const char *s, int base, long min, long max, long *v) {
+	char *end;
+
+	errno = 0;
+	*v = strtol(s, &end, base);
+	if(end == s || *end != '\0' || errno == ERANGE || *v < min || *v > max)
+		return -1;
+	return 0;
+}
+
+/*
+ | ParseCounter:
+ | Convert whole string s of decimal digits to a counter up to ULONG_MAX.
+ | Return 0 on success, -1 if s is not such a number.
+ */
+static int ParseCounter(const char *s, unsigned long *v) {
+	char *end;
+
+	if(*s < '0' || *s > '9')
+		return -1;	// strtoul() would take a sign
+	errno = 0;
+	*v = strtoul(s, &end, 10);
+	if(*end != '\0' || errno == ERANGE)
+		return -1;
+	return 0;
+}
+
+/*
+ | ParseEntry:
+ | Parse cache file line to e.
+ | Return 0 on success, -1 if the line is invalid.
+ */
+static int ParseEntry(const char *line, struct reg_cache_entry *e) {
+	char value[2 * REG_CACHE_MAX_LEN + 2];
+	char policy[16], reg[16], stamp[24], hits[24], misses[24];
+	unsigned int byte;
+	long v;
+	int n, i, len;
+
+	memset(e, 0, sizeof(*e));
+	n = sscanf(line, "%63s %15s %15s %65s %23s %23s %23s", e->device, reg, policy, value, stamp, hits, misses);
+	if(n < 3 || ParseI2CPath(e->device, &e->path) < 0)
+		return -1;
+	if(ParseNumber(reg, 0, 0, 0xFF, &v) < 0)
+		return -1;
+	e->reg = v;
+	if(strcmp(policy, "wt") == 0)
+		e->ttl = REG_CACHE_WRITE_THROUGH;
+	else if(ParseNumber(policy, 10, 0, 0x7FFFFFFF, &v) == 0)
+		e->ttl = v;
+	else
+		return -1;
+	if(n >= 4 && strcmp(value, "-") != 0) {
+		len = strlen(value);
+		if(len % 2 || len > 2 * REG_CACHE_MAX_LEN || strspn(value, "0123456789abcdefABCDEF") != (size_t)len)
+			return -1;
+		for(i = 0; i < len / 2; i++) {
+			sscanf(&value[2 * i], "%2x", &byte);
+			e->value[i] = byte;
+		}
+		e->len = len / 2;
+	}
+	if(n >= 5 && ParseNumber(stamp, 10, 0, LONG_MAX, &e->stamp) < 0)
+		return -1;
+	if(n >= 6 && ParseCounter(hits, &e->hits) < 0)
+		return -1;
+	if(n >= 7 && ParseCounter(misses, &e->misses) < 0)
+		return -1;
+	return 0;
+}
+
+/*
+ | RegCacheOpen:
+ | Lock and load cache file.
+ | The file stays locked until RegCacheClose() so concurrent runs don't lose updates.
+ | Return 0 on success, -1 on error.
+ */
+int RegCacheOpen(const char *filename) {
+	char line[256];
+	struct reg_cache_line *l;
+
+	RegCacheFile = fopen(filename, "r+");
+	if(RegCacheFile == NULL) {
+		printf("Can't open register cache file %s\n", filename);
+		return -1;
+	}
+	flock(fileno(RegCacheFile), LOCK_EX);
+	RegCacheEntries = 0;
+	RegCacheNumLines = 0;
+	RegCacheKeepFile = 0;
+	while(fgets(line, sizeof(line), RegCacheFile) != NULL) {
+		if(RegCacheNumLines == REG_CACHE_MAX_LINES) {
+			printf("Register cache file too long, it is not updated\n");
+			RegCacheKeepFile = 1;
+			break;
+		}
+		l = &RegCacheLines[RegCacheNumLines++];
+		l->text = NULL;
+		l->entry = -1;
+		if(line[0] == '#' || line[0] == '\n' || line[strlen(line) - 1] != '\n') {
+			l->text = strdup(line);	// Comment, empty line or part of a line too long to be ours
+			continue;
+		}
+		if(RegCacheEntries == REG_CACHE_MAX_ENTRIES) {
+			printf("Too many registers in cache file: %s", line);
+			l->text = strdup(line);
+			continue;
+		}
+		if(ParseEntry(line, &RegCache[RegCacheEntries]) < 0) {
+			printf("Invalid register cache line: %s", line);
+			l->text = strdup(line);
+			continue;
+		}
+		l->entry = RegCacheEntries++;
+	}
+	return 0;
+}
+
+/*
+ | FindEntry:
+ | Return cache entry of register reg of device in path or NULL if it is not declared.
+ */
+static struct reg_cache_entry *FindEntry(const struct i2c_path *path, unsigned char reg) {
+	int i;
+
+	for(i = 0; i < RegCacheEntries; i++) {
+		if(RegCache[i].reg == reg && memcmp(&RegCache[i].path, path, sizeof(*path)) == 0)
+			return &RegCache[i];
+	}
+	return NULL;
+}
+
+/*
+ | RegCacheLookup:
+ | Look for len bytes starting at register reg of device in path.
+ | Return 1 and copy the bytes to buf on hit, 0 on miss.
+ */
+int RegCacheLookup(const struct i2c_path *path, unsigned char reg, unsigned char *buf, int len) {
+	struct reg_cache_entry *e;
+
+	e = FindEntry(path, reg);
+	if(e == NULL)
+		return 0;
+	if(e->len >= len && (e->ttl == REG_CACHE_WRITE_THROUGH || time(NULL) - e->stamp < e->ttl)) {
+		memcpy(buf, e->value, len);
+		if(e->hits < ULONG_MAX)
+			e->hits++;
+		return 1;
+	}
+	if(e->misses < ULONG_MAX)
+		e->misses++;
+	return 0;
+}
+
+/*
+ | RegCacheStore:
+ | Store bytes read from the device after a miss.
+ */
+void RegCacheStore(const struct i2c_path *path, unsigned char reg, const unsigned char *buf, int len) {
+	struct reg_cache_entry *e;
+
+	e = FindEntry(path, reg);
+	if(e == NULL || len > REG_CACHE_MAX_LEN)
+		return;
+	memcpy(e->value, buf, len);
+	e->len = len;
+	e->stamp = time(NULL);
+}
+
+/*
+ | RegCacheWrite:
+ | Update the cache after len data bytes were written starting at register reg.
+ | Registers are assumed to auto increment, so byte i of data went to register reg + i.
+ | Write-through registers get the new bytes, others are invalidated.
+ | If the write failed (ok is 0) all registers of the device are invalidated.
+ */
+void RegCacheWrite(const struct i2c_path *path, unsigned char reg, const unsigned char *data, int len, int ok) {
+	struct reg_cache_entry *e;
+	int i, j;
+
+	for(i = 0; i < RegCacheEntries; i++) {
+		e = &RegCache[i];
+		if(e->len == 0 || memcmp(&e->path, path, sizeof(*path)) != 0)
+			continue;
+		if(!ok) {
+			e->len = 0;
+			continue;
+		}
+		if(reg + len <= e->reg || e->reg + e->len <= reg)
+			continue;	/* Not overlapping */
+		if(e->ttl != REG_CACHE_WRITE_THROUGH) {
+			e->len = 0;
+			continue;
+		}
+		for(j = 0; j < len; j++) {
+			if(reg + j >= e->reg && reg + j < e->reg + e->len)
+				e->value[reg + j - e->reg] = data[j];
+		}
+	}
+}
+
+/*
+ | RegCacheClose:
+ | Write cache file back and unlock it.
+ | Lines that are not registers are written back as they were.
+ */
+void RegCacheClose(void) {
+	struct reg_cache_entry *e;
+	int i, j;
+
+	if(RegCacheFile == NULL)
+		return;
+	if(!RegCacheKeepFile) {
+		rewind(RegCacheFile);
+		if(RegCacheNumLines == 0 || RegCacheLines[0].text == NULL || RegCacheLines[0].text[0] != '#')
+			fprintf(RegCacheFile, "# device register ttl|wt value time hits misses\n");
+		for(i = 0; i < RegCacheNumLines; i++) {
+			if(RegCacheLines[i].entry < 0) {
+				fputs(RegCacheLines[i].text, RegCacheFile);
+				continue;
+			}
+			e = &RegCache[RegCacheLines[i].entry];
+			fprintf(RegCacheFile, "%s 0x%02X ", e->device, e->reg);
+			if(e->ttl == REG_CACHE_WRITE_THROUGH)
+				fprintf(RegCacheFile, "wt ");
+			else
+				fprintf(RegCacheFile, "%d ", e->ttl);
+			if(e->len == 0)
+				fprintf(RegCacheFile, "-");
+			for(j = 0; j < e->len; j++)
+				fprintf(RegCacheFile, "%02X", e->value[j]);
+			fprintf(RegCacheFile, " %ld %lu %lu\n", e->stamp, e->hits, e->misses);
+		}
+		fflush(RegCacheFile);
+		ftruncate(fileno(RegCacheFile), ftell(RegCacheFile));
+	}
+	for(i = 0; i < RegCacheNumLines; i++)
+		free(RegCacheLines[i].text);
+	RegCacheNumLines = 0;
+	flock(fileno(RegCacheFile), LOCK_UN);
+	fclose(RegCacheFile);
+	RegCacheFile = NULL;
+}
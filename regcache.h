@@ -0,0 +1,50 @@
+/*
+ | Register shadow cache for read-mostly device registers.
+ |
+ | Written by Ori Idan, Helicon technologies LTD. (ori@helicontech.co.il)
+ |
+ | This file is free software: you can redistribute it and/or modify it
+ | under the terms of the GNU General Public License as published by the
+ | Free Software Foundation, either version 3 of the License, or
+ | (at your option) any later version.
+ |
+ | This file is distributed in the hope that it will be useful, but
+ | WITHOUT ANY WARRANTY; without even the implied warranty of
+ | MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ | See the GNU General Public License for more details.
+ |
+ | You should have received a copy of the GNU General Public License along
+ | with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#ifndef REGCACHE_H
+#define REGCACHE_H
+
+#include "i2cmux.h"
+
+#define REG_CACHE_MAX_ENTRIES 256	// Maximum number of cached registers
+#define REG_CACHE_MAX_LINES 1024	// Maximum number of lines in the cache file, including comments
+#define REG_CACHE_MAX_LEN 32	// Maximum number of bytes cached for one register
+#define REG_CACHE_WRITE_THROUGH (-1)	// ttl value of registers that never expire and are updated by writes
+
+/*
+ | Cached register.
+ | Only registers declared in the cache file are cached.
+ */
+struct reg_cache_entry {
+	char device[64];	// Device path as given in the cache file
+	struct i2c_path path;
+	unsigned char reg;
+	int ttl;	// Time to live in seconds or REG_CACHE_WRITE_THROUGH
+	int len;	// Number of bytes cached starting at reg, 0 if nothing cached
+	unsigned char value[REG_CACHE_MAX_LEN];
+	long stamp;	// Time value was read from the device
+	unsigned long hits, misses;
+};
+
+int RegCacheOpen(const char *filename);
+int RegCacheLookup(const struct i2c_path *path, unsigned char reg, unsigned char *buf, int len);
+void RegCacheStore(const struct i2c_path *path, unsigned char reg, const unsigned char *buf, int len);
+void RegCacheWrite(const struct i2c_path *path, unsigned char reg, const unsigned char *data, int len, int ok);
+void RegCacheClose(void);
+
+#endif
@@ -0,0 +1,239 @@
+/*
+ | Tests of the bus owner submission queue and scheduler (ftdi-i2c-bus.c), run by make check.
+ | The bus code is included so its static functions can be tested without an FT4232H.
+ |
+ | Written by Ori Idan, Helicon technologies LTD. (ori@helicontech.co.il)
+ |
+ | This file is free software: you can redistribute it and/or modify it
+ | under the terms of the GNU General Public License as published by the
+ | Free Software Foundation, either version 3 of the License, or
+ | (at your option) any later version.
+ |
+ | This file is distributed in the hope that it will be useful, but
+ | WITHOUT ANY WARRANTY; without even the implied warranty of
+ | MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ | See the GNU General Public License for more details.
+ |
+ | You should have received a copy of the GNU General Public License along
+ | with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include "../ftdi-i2c-bus.c"
+
+#define PRODUCERS 4
+#define PER_PRODUCER 20000
+
+static int failed = 0;
+
+#define CHECK(c) do { if(!(c)) { printf("%s:%d: %s failed\n", __FILE__, __LINE__, #c); failed++; } } while(0)
+
+static struct ftdi_i2c_bus bus;
+static struct ftdi_i2c_request requests[PRODUCERS][PER_PRODUCER];
+
+/*
+ | InitQueue:
+ | Set up the submission queue like ftdi_i2c_bus_start() without starting the thread.
+ */
+static void InitQueue(void) {
+	memset(&bus, 0, sizeof(bus));
+	atomic_store(&bus.stub.next, NULL);
+	atomic_store(&bus.head, &bus.stub);
+	bus.tail = &bus.stub;
+}
+
+static void TestQueue(void) {
+	struct ftdi_i2c_request r[3];
+	int i;
+
+	InitQueue();
+	CHECK(Empty(&bus));
+	CHECK(Pop(&bus) == NULL);
+	for(i = 0; i < 3; i++)
+		Push(&bus, &r[i]);
+	CHECK(!Empty(&bus));
+	for(i = 0; i < 3; i++)
+		CHECK(Pop(&bus) == &r[i]);
+	CHECK(Pop(&bus) == NULL);
+	CHECK(Empty(&bus));
+	/* Works again after the stub was put back behind the last request */
+	Push(&bus, &r[1]);
+	CHECK(!Empty(&bus));
+	CHECK(Pop(&bus) == &r[1]);
+	CHECK(Pop(&bus) == NULL);
+	CHECK(Empty(&bus));
+}
+
+static void *Producer(void *arg) {
+	long id = (long)arg;
+	int i;
+
+	for(i = 0; i < PER_PRODUCER; i++) {
+		requests[id][i].nmsgs = i;	// Sequence number
+		requests[id][i].arg = (void *)id;
+		Push(&bus, &requests[id][i]);
+	}
+	return NULL;
+}
+
+static void TestQueueThreads(void) {
+	pthread_t threads[PRODUCERS];
+	int next[PRODUCERS] = { 0 };
+	struct ftdi_i2c_request *req;
+	long id;
+	int n = 0;
+	int order = 1;
+
+	InitQueue();
+	for(id = 0; id < PRODUCERS; id++)
+		pthread_create(&threads[id], NULL, Producer, (void *)id);
+	/* Drain while producers push, every request once and in order per producer */
+	while(n < PRODUCERS * PER_PRODUCER) {
+		req = Pop(&bus);
+		if(req == NULL)
+			continue;
+		id = (long)req->arg;
+		if(req->nmsgs != next[id])
+			order = 0;
+		next[id] = req->nmsgs + 1;
+		n++;
+	}
+	for(id = 0; id < PRODUCERS; id++)
+		pthread_join(threads[id], NULL);
+	CHECK(order);
+	CHECK(Pop(&bus) == NULL);
+	CHECK(Empty(&bus));
+}
+
+static void TestSlices(void) {
+	unsigned char buf[40];
+	struct ftdi_i2c_msg msgs[7] = {
+		{ 0x50, FTDI_I2C_M_STOP, 1, buf },	// Transaction of 2 bytes
+		{ 0x50, 0, 1, buf },
+		{ 0x50, FTDI_I2C_M_RD | FTDI_I2C_M_STOP, 4, buf },	// 7 bytes
+		{ 0x50, FTDI_I2C_M_STOP, 40, buf },	// 41 bytes
+		{ 0x50, 0, 2, buf },
+		{ 0x50, FTDI_I2C_M_RD | FTDI_I2C_M_STOP, 2, buf },	// 6 bytes
+		{ 0x50, 0, 1, buf },	// Last message ends a transaction too, 2 bytes
+	};
+	struct ftdi_i2c_request req;
+	int cost;
+
+	memset(&req, 0, sizeof(req));
+	req.msgs = msgs;
+	req.nmsgs = 7;
+	CHECK(SliceLength(&req, 10, &cost) == 3 && cost == 9);	// Next transaction does not fit
+	CHECK(SliceLength(&req, 2, &cost) == 1 && cost == 2);	// Budget reached exactly
+	CHECK(SliceLength(&req, 1, &cost) == 1 && cost == 2);	// At least one transaction
+	CHECK(SliceLength(&req, INT_MAX, &cost) == 7 && cost == 58);
+	req.next_msg = 3;
+	CHECK(SliceLength(&req, 10, &cost) == 1 && cost == 41);	// Bigger than budget, sent alone
+	req.next_msg = 4;
+	CHECK(SliceLength(&req, 8, &cost) == 3 && cost == 8);
+	CHECK(SliceLength(&req, 7, &cost) == 2 && cost == 6);	// Never splits a transaction
+	req.next_msg = 7;
+	CHECK(SliceLength(&req, 10, &cost) == 0 && cost == 0);
+}
+
+static void TestDeadlineOrder(void) {
+	struct ftdi_i2c_request r[5];
+	struct ftdi_i2c_request *req;
+	int order[5] = { 1, 3, 0, 2 };
+	int i;
+
+	InitQueue();
+	memset(r, 0, sizeof(r));
+	r[0].deadline_ns = 300;
+	r[1].deadline_ns = 100;
+	r[2].deadline_ns = ~0ULL;	// No deadline
+	r[3].deadline_ns = 100;	// Same deadline as r[1], submitted later
+	for(i = 0; i < 4; i++)
+		Ready(&bus, &r[i]);
+	for(i = 0, req = bus.ready[FTDI_I2C_PRIO_NORMAL]; i < 4; i++, req = req->sched_next)
+		CHECK(req == &r[order[i]]);
+	CHECK(req == NULL);
+	/* Zero initialized requests are normal, invalid classes too */
+	CHECK(FTDI_I2C_PRIO_NORMAL == 0);
+	r[4].priority = 7;
+	r[4].deadline_ns = 200;
+	Ready(&bus, &r[4]);
+	CHECK(r[4].priority == FTDI_I2C_PRIO_NORMAL && r[1].sched_next->sched_next == &r[4]);
+	CHECK(bus.ready[FTDI_I2C_PRIO_HIGH] == NULL && bus.ready[FTDI_I2C_PRIO_BULK] == NULL);
+}
+
+/*
+ | SegmentsOf:
+ | Number of segments queued in ctx that report to status.
+ */
+static int SegmentsOf(struct ftdi_i2c_context *ctx, int *status) {
+	unsigned int i;
+	int n = 0;
+
+	for(i = 0; i < ctx->dwNumSegments; i++)
+		if(ctx->Segments[i].status == status)
+			n++;
+	return n;
+}
+
+static void TestMuxBatch(void) {
+	static struct ftdi_i2c_context ctx;
+	struct i2c_path paths[3] = {
+		{ 1, { 0x70 }, { 0 }, 0x48 },
+		{ 1, { 0x70 }, { 1 }, 0x48 },
+		{ 1, { 0x70 }, { 1 }, 0x49 },
+	};
+	unsigned char buf[4];
+	struct ftdi_i2c_msg msgs[4];
+	struct ftdi_i2c_request r[4];
+	struct ftdi_i2c_request *batch[FTDI_I2C_BUS_MAX_BATCH];
+	int muxstatus[FTDI_I2C_BUS_MAX_BATCH];
+	int i;
+
+	InitQueue();
+	CHECK(ftdi_i2c_init(&ctx) == 0);
+	bus.ctx = &ctx;
+	memset(r, 0, sizeof(r));
+	for(i = 0; i < 4; i++) {
+		msgs[i].addr = (i < 3) ? paths[i].addr : 0x20;
+		msgs[i].flags = 0;
+		msgs[i].len = 1;
+		msgs[i].buf = &buf[i];
+		r[i].msgs = &msgs[i];
+		r[i].nmsgs = 1;
+		r[i].path = (i < 3) ? &paths[i] : NULL;
+		r[i].deadline_ns = 100 + i;
+		Ready(&bus, &r[i]);
+	}
+	/* Requests on other channels share the batch, each select planned from the one before */
+	CHECK(BuildBatch(&bus, batch, muxstatus) == 4);
+	for(i = 0; i < 4; i++)
+		CHECK(batch[i] == &r[i] && muxstatus[i] == 0);
+	CHECK(SegmentsOf(&ctx, &muxstatus[0]) == 1 && SegmentsOf(&ctx, &muxstatus[1]) == 1);
+	CHECK(SegmentsOf(&ctx, &muxstatus[2]) == 0 && SegmentsOf(&ctx, &muxstatus[3]) == 0);
+	/* Nothing is sent, the stream is dropped */
+	ctx.dwNumBytesToSend = 0;
+	ctx.dwNumSegments = 0;
+	ctx.dwNumRxPending = 0;
+	ftdi_deinit(&ctx.ftdic);
+
+	/* A failed select fails its request and everything after it, not what came before */
+	muxstatus[1] = FTDI_I2C_ENACK;
+	r[2].status = FTDI_I2C_EIO;	// Own error is kept
+	MuxErrors(batch, muxstatus, 4);
+	CHECK(r[0].status == 0);
+	CHECK(r[1].status == FTDI_I2C_ENACK && r[2].status == FTDI_I2C_EIO && r[3].status == FTDI_I2C_ENACK);
+	for(i = 0; i < 4; i++)
+		r[i].status = 0;
+	memset(muxstatus, 0, sizeof(muxstatus));
+	MuxErrors(batch, muxstatus, 4);
+	for(i = 0; i < 4; i++)
+		CHECK(r[i].status == 0);
+}
+
+int main(void) {
+	TestQueue();
+	TestQueueThreads();
+	TestSlices();
+	TestDeadlineOrder();
+	TestMuxBatch();
+	printf("test-bus: %s\n", failed ? "FAILED" : "OK");
+	return failed ? 1 : 0;
+}
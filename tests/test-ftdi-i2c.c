@@ -0,0 +1,415 @@
+/*
+ | Tests of the MPSSE command stream and reply handling (ftdi-i2c.c), run by make check.
+ | ftdi_write_data() and ftdi_read_data() are wrapped at link time (ld --wrap), so the
+ | library talks to a fake FT4232H: commands are collected in Sent, replies come from Reply.
+ |
+ | Written by Ori Idan, Helicon technologies LTD. (ori@helicontech.co.il)
+ |
+ | This file is free software: you can redistribute it and/or modify it
+ | under the terms of the GNU General Public License as published by the
+ | Free Software Foundation, either version 3 of the License, or
+ | (at your option) any later version.
+ |
+ | This file is distributed in the hope that it will be useful, but
+ | WITHOUT ANY WARRANTY; without even the implied warranty of
+ | MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ | See the GNU General Public License for more details.
+ |
+ | You should have received a copy of the GNU General Public License along
+ | with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "ftdi-i2c.h"
+
+static int failed = 0;
+
+#define CHECK(c) do { if(!(c)) { printf("%s:%d: %s failed\n", __FILE__, __LINE__, #c); failed++; } } while(0)
+
+static struct ftdi_i2c_context ctx;
+static unsigned char Sent[262144];	// Everything written to the fake FT4232H
+static unsigned int SentLen;
+static unsigned char Reply[4096];	// What the fake FT4232H sends back
+static unsigned int ReplyLen, ReplyPos;
+static int ReadChunk;	// Most bytes returned by one read, 0 for no limit
+static int ReadFail;	// Read number ReadFail from now fails, 0 for never
+static int Purged;	// Number of purges after errors
+
+int __wrap_ftdi_write_data(struct ftdi_context *ftdic, const unsigned char *buf, int size) {
+	if(SentLen + size <= sizeof(Sent)) {
+		memcpy(Sent + SentLen, buf, size);
+		SentLen += size;
+	}
+	return size;
+}
+
+int __wrap_ftdi_read_data(struct ftdi_context *ftdic, unsigned char *buf, int size) {
+	int n = ReplyLen - ReplyPos;
+
+	if(ReadFail && --ReadFail == 0)
+		return -1;
+	if(n > size)
+		n = size;
+	if(ReadChunk && n > ReadChunk)
+		n = ReadChunk;
+	memcpy(buf, Reply + ReplyPos, n);
+	ReplyPos += n;
+	return n;
+}
+
+int __wrap_ftdi_usb_purge_buffers(struct ftdi_context *ftdic) {
+	Purged++;
+	return 0;
+}
+
+/*
+ | Reset:
+ | Start a test with a fresh context and nothing sent or to be sent back.
+ */
+static void Reset(void) {
+	ftdi_i2c_init(&ctx);
+	ctx.ReadTimeout = 20;	// ms, replies that are not in Reply never come
+	SentLen = 0;
+	ReplyLen = ReplyPos = 0;
+	ReadChunk = 0;
+	ReadFail = 0;
+	Purged = 0;
+}
+
+/*
+ | SetReply:
+ | Bytes the fake FT4232H sends back, n zero bytes (ACK bits) if b is NULL.
+ */
+static void SetReply(const unsigned char *b, unsigned int n) {
+	if(b != NULL)
+		memcpy(Reply, b, n);
+	else
+		memset(Reply, 0, n);
+	ReplyLen = n;
+	ReplyPos = 0;
+}
+
+/*
+ | Next:
+ | Return length of the MPSSE command at Sent[i].
+ */
+static unsigned int Next(unsigned int i) {
+	switch(Sent[i]) {
+	case 0x80: case 0x82: case 0x86: case 0x24: case 0x8F:
+		return 3;
+	case 0x11:
+		return 3 + Sent[i + 1] + (Sent[i + 2] << 8) + 1;
+	case 0x22: case 0x8E:
+		return 2;
+	default:
+		return 1;
+	}
+}
+
+/*
+ | Count:
+ | Return number of commands cmd sent.
+ */
+static int Count(unsigned char cmd) {
+	unsigned int i;
+	int n = 0;
+
+	for(i = 0; i < SentLen; i += Next(i)) {
+		if(Sent[i] == cmd)
+			n++;
+	}
+	return n;
+}
+
+/*
+ | BytesOut:
+ | Collect the bytes clocked out to the bus by 0x11 commands, return their number.
+ */
+static int BytesOut(unsigned char *out, int max) {
+	unsigned int i, len;
+	int n = 0;
+
+	for(i = 0; i < SentLen; i += Next(i)) {
+		if(Sent[i] != 0x11)
+			continue;
+		for(len = 0; len < Next(i) - 3 && n < max; len++)
+			out[n++] = Sent[i + 3 + len];
+	}
+	return n;
+}
+
+/*
+ | DelayClocks:
+ | Return number of clocks of the 0x8E and 0x8F (clock with no data) commands sent.
+ */
+static unsigned long DelayClocks(void) {
+	unsigned int i;
+	unsigned long clocks = 0;
+
+	for(i = 0; i < SentLen; i += Next(i)) {
+		if(Sent[i] == 0x8F)
+			clocks += (Sent[i + 1] + (Sent[i + 2] << 8) + 1) * 8UL;
+		else if(Sent[i] == 0x8E)
+			clocks += Sent[i + 1] + 1;
+	}
+	return clocks;
+}
+
+/*
+ | PinsKept:
+ | Return 1 if all set data bits low byte commands drive GPIOL0-3 to value with directions dir.
+ */
+static int PinsKept(unsigned char value, unsigned char dir) {
+	unsigned int i;
+
+	for(i = 0; i < SentLen; i += Next(i)) {
+		if(Sent[i] == 0x80 && ((Sent[i + 1] >> 4) != value || (Sent[i + 2] >> 4) != dir))
+			return 0;
+	}
+	return 1;
+}
+
+static void TestQueue(void) {
+	unsigned char wbuf[2] = { 0x01, 0x02 };
+	unsigned char rbuf[3];
+	unsigned char reply[7] = { 0x00, 0x00, 0x00, 0x00, 0x11, 0x22, 0x33 };
+	unsigned char out[8];
+	struct ftdi_i2c_msg msgs[2] = {
+		{ 0x50, 0, 2, wbuf },
+		{ 0x50, FTDI_I2C_M_RD, 3, rbuf },
+	};
+	int status = 0;
+
+	Reset();
+	CHECK(ftdi_i2c_queue(&ctx, msgs, 2, &status) == 0);
+	CHECK(SentLen == 0 && ctx.dwNumBytesToSend > 0);	// Nothing goes out before flush
+	/* ACK bits of both messages are merged, read data has a segment of its own */
+	CHECK(ctx.dwNumSegments == 2 && ctx.dwNumRxPending == 7);
+	CHECK(ctx.Segments[0].buf == NULL && ctx.Segments[0].len == 4 && ctx.Segments[0].status == &status);
+	CHECK(ctx.Segments[1].buf == rbuf && ctx.Segments[1].len == 3);
+	SetReply(reply, sizeof(reply));
+	CHECK(ftdi_i2c_flush(&ctx) == 0 && status == 0);
+	CHECK(rbuf[0] == 0x11 && rbuf[1] == 0x22 && rbuf[2] == 0x33);
+	CHECK(ctx.dwNumSegments == 0 && ctx.dwNumRxPending == 0 && ReplyPos == ReplyLen);
+	/* One stream: address, data, repeated start, address, read, send immediate at the end */
+	CHECK(BytesOut(out, sizeof(out)) == 4 && out[0] == 0xA0 && out[1] == 0x01 && out[2] == 0x02 && out[3] == 0xA1);
+	CHECK(Count(0x22) == 4 && Count(0x24) == 3 && Count(0x87) == 1 && Sent[SentLen - 1] == 0x87);
+}
+
+static void TestLongRead(void) {
+	static unsigned char rbuf[1500];
+	struct ftdi_i2c_msg msg = { 0x50, FTDI_I2C_M_RD, sizeof(rbuf), rbuf };
+	unsigned int i;
+	int status = 0;
+	int ok = 1;
+
+	Reset();
+	Reply[0] = 0x00;	// Address ACK
+	for(i = 0; i < sizeof(rbuf); i++)
+		Reply[1 + i] = i;
+	ReplyLen = 1 + sizeof(rbuf);
+	CHECK(ftdi_i2c_queue(&ctx, &msg, 1, &status) == 0);
+	/* The oldest replies were read while queueing, the FT4232H never holds more than it may */
+	CHECK(ReplyPos > 0 && ctx.dwNumRxPending <= FTDI_I2C_MAX_PENDING_RX);
+	CHECK(ctx.dwNumRxPending + ReplyPos == 1 + sizeof(rbuf));
+	CHECK(ftdi_i2c_flush(&ctx) == 0 && status == 0);
+	for(i = 0; i < sizeof(rbuf); i++) {
+		if(rbuf[i] != (i & 0xFF))
+			ok = 0;
+	}
+	CHECK(ok);
+}
+
+static void TestTransfer(void) {
+	unsigned char wbuf[2] = { 0x01, 0x02 };
+	unsigned char rbuf[2];
+	unsigned char nack[3] = { 0x00, 0x00, 0x01 };
+	struct ftdi_i2c_msg msgs[2] = {
+		{ 0x50, 0, 2, wbuf },
+		{ 0x50, FTDI_I2C_M_RD, 2, rbuf },
+	};
+
+	Reset();
+	SetReply(nack, sizeof(nack));
+	CHECK(ftdi_i2c_transfer(&ctx, msgs, 1) == FTDI_I2C_ENACK);	// Second data byte not acknowledged
+	/* Replies trickle in a byte at a time */
+	Reset();
+	SetReply(NULL, 6);
+	Reply[4] = 0x5A;
+	ReadChunk = 1;
+	CHECK(ftdi_i2c_transfer(&ctx, msgs, 2) == 2 && rbuf[0] == 0x5A);
+	/* Replies that never come */
+	Reset();
+	SetReply(NULL, 5);
+	CHECK(ftdi_i2c_transfer(&ctx, msgs, 2) == FTDI_I2C_EIO);
+	CHECK(ctx.dwNumSegments == 0 && ctx.dwNumRxPending == 0);
+	/* USB error */
+	Reset();
+	SetReply(NULL, 6);
+	ReadFail = 1;
+	CHECK(ftdi_i2c_transfer(&ctx, msgs, 2) == FTDI_I2C_EIO && Purged == 1);
+	/* The next transfer starts afresh */
+	SetReply(NULL, 6);
+	CHECK(ftdi_i2c_transfer(&ctx, msgs, 2) == 2);
+}
+
+static void TestInvalid(void) {
+	unsigned char buf[1];
+	struct ftdi_i2c_msg msg = { 0x50, FTDI_I2C_M_RD, 0, buf };
+
+	Reset();
+	CHECK(ftdi_i2c_transfer(&ctx, &msg, -1) == FTDI_I2C_EINVAL);
+	CHECK(ftdi_i2c_transfer(&ctx, &msg, 1) == FTDI_I2C_EINVAL);	// Read of no bytes
+	msg.flags = 0;
+	msg.addr = 0x80;
+	CHECK(ftdi_i2c_transfer(&ctx, &msg, 1) == FTDI_I2C_EINVAL);
+	CHECK(ctx.dwNumBytesToSend == 0 && ctx.dwNumSegments == 0 && SentLen == 0);	// Nothing queued
+	/* Channels C and D have no MPSSE */
+	CHECK(ftdi_i2c_open(&ctx, 2, 0) == FTDI_I2C_EINVAL);
+	CHECK(ftdi_i2c_open(&ctx, -1, 0) == FTDI_I2C_EINVAL);
+}
+
+static void TestAsync(void) {
+	unsigned char buf[1] = { 0x55 };
+	unsigned char nack[6] = { 0x00, 0x00, 0x00, 0x01, 0x00, 0x00 };
+	struct ftdi_i2c_msg msg = { 0x60, 0, 1, buf };
+	struct i2c_path path;
+	long frames[8];
+	int i;
+
+	Reset();
+	CHECK(ftdi_i2c_write_async(&ctx, &msg, 1) == 0);
+	buf[0] = 0xAA;	// Data was copied
+	CHECK(ftdi_i2c_write_async(&ctx, &msg, 1) == 1);
+	msg.flags = FTDI_I2C_M_RD;
+	CHECK(ftdi_i2c_write_async(&ctx, &msg, 1) == FTDI_I2C_EINVAL);	// No index used
+	msg.flags = 0;
+	CHECK(ftdi_i2c_write_async(&ctx, &msg, 1) == 2);
+	CHECK(ctx.dwNumSegments == 3 && ctx.Segments[0].frame == 0 && ctx.Segments[2].frame == 2 && ctx.QueueFrame == -1);
+	/* Data byte of frame 1 not acknowledged */
+	SetReply(nack, sizeof(nack));
+	CHECK(ftdi_i2c_sync(&ctx, frames, 8) == 1 && frames[0] == 1);
+	CHECK(ftdi_i2c_sync(&ctx, frames, 8) == 0);
+
+	/* USB error while replies are read in the background, later frames go out fine */
+	Reset();
+	SetReply(NULL, 2 * 600);
+	ReadFail = 1;
+	for(i = 0; i < 600; i++)
+		ftdi_i2c_write_async(&ctx, &msg, 1);
+	CHECK(Purged == 1 && ctx.dwNumRxPending < 2 * 600);
+	CHECK(ftdi_i2c_sync(&ctx, frames, 8) == FTDI_I2C_EIO);
+	ftdi_i2c_write_async(&ctx, &msg, 1);
+	SetReply(NULL, 2);
+	CHECK(ftdi_i2c_sync(&ctx, frames, 8) == 0);
+
+	/* Mux select before the frames not acknowledged */
+	Reset();
+	ParseI2CPath("mux@0x70/ch1/0x60", &path);
+	ftdi_i2c_select(&ctx, &path);
+	ftdi_i2c_write_async(&ctx, &msg, 1);
+	SetReply(nack + 2, 4);
+	Reply[0] = 0x01;
+	CHECK(ftdi_i2c_sync(&ctx, frames, 8) == FTDI_I2C_ENACK);
+	CHECK(!ctx.mux.level[0].valid);	// Written again by the next select
+	SetReply(NULL, 2);
+	CHECK(ftdi_i2c_transfer(&ctx, &msg, 1) == 1);	// Not failed by the mux error reported at sync
+}
+
+static void TestClose(void) {
+	unsigned char buf[1] = { 0x55 };
+	struct ftdi_i2c_msg msg = { 0x60, 0, 1, buf };
+	struct i2c_path path;
+	unsigned char out[8];
+
+	/* Muxes opened by the run are closed, deepest first */
+	Reset();
+	ParseI2CPath("mux@0x70/ch1/mux@0x74/ch2/0x60", &path);
+	ftdi_i2c_select(&ctx, &path);
+	SetReply(NULL, 6);
+	CHECK(ftdi_i2c_transfer(&ctx, &msg, 1) == 1);
+	SentLen = 0;
+	SetReply(NULL, 4);
+	ftdi_i2c_close(&ctx);
+	CHECK(BytesOut(out, sizeof(out)) == 4 && out[0] == 0xE8 && out[1] == 0x00 && out[2] == 0xE0 && out[3] == 0x00);
+	CHECK(!ctx.mux.level[0].valid && !ctx.mux.level[1].valid);
+
+	/* Nothing to close, nothing sent */
+	Reset();
+	ftdi_i2c_close(&ctx);
+	CHECK(SentLen == 0);
+}
+
+static void TestDelay(void) {
+	Reset();
+	ctx.dwClockDivisor = 0;	// 30 clocks per us
+	ftdi_i2c_queue_delay(&ctx, 3);
+	ftdi_i2c_flush(&ctx);
+	CHECK(DelayClocks() == 90 && Count(0x8F) == 1 && Count(0x8E) == 1);
+	/* SCL and SDA are released before clocking */
+	CHECK(Sent[0] == 0x80 && (Sent[1] & 0x03) == 0 && (Sent[2] & 0x03) == 0);
+	/* More than 0x10000 bytes of clocks need two commands */
+	Reset();
+	ctx.dwClockDivisor = 0;
+	ftdi_i2c_queue_delay(&ctx, 20000);
+	ftdi_i2c_flush(&ctx);
+	CHECK(DelayClocks() == 600000 && Count(0x8F) == 2 && Count(0x8E) == 0);
+	/* 200 kHz default, 0.2 clocks per us */
+	Reset();
+	ftdi_i2c_queue_delay(&ctx, 1000);
+	ftdi_i2c_flush(&ctx);
+	CHECK(DelayClocks() == 200);
+	Reset();
+	ftdi_i2c_queue_delay(&ctx, 4);
+	ftdi_i2c_flush(&ctx);
+	CHECK(DelayClocks() == 0 && Count(0x8E) == 0 && Count(0x8F) == 0);	// Less than a clock
+}
+
+static void TestGPIO(void) {
+	unsigned char buf[1] = { 0x00 };
+	struct ftdi_i2c_msg msg = { 0x50, 0, 1, buf };
+	unsigned char value = 0, high = 0;
+	unsigned char reply[2] = { 0xA3, 0x5C };
+	int status = 0;
+
+	Reset();
+	CHECK(ftdi_i2c_queue_gpio_set(&ctx, FTDI_I2C_GPIOL, 0xF5, 0x05) == 0);
+	CHECK(ftdi_i2c_queue_gpio_input(&ctx, FTDI_I2C_GPIOL, 0x02) == 0);
+	CHECK(ctx.gpio == 0x05 && ctx.gpiodir == 0x0D);	// Only GPIOL0-3
+	CHECK(ftdi_i2c_queue(&ctx, &msg, 1, &status) == 0);
+	SetReply(NULL, 2);
+	CHECK(ftdi_i2c_flush(&ctx) == 0 && status == 0);
+	/* Transfers keep the GPIOL values and directions */
+	CHECK(Sent[0] == 0x80 && Sent[1] == 0x50 && Sent[2] == 0xF0);
+	SentLen = 0;
+	ftdi_i2c_queue(&ctx, &msg, 1, &status);
+	SetReply(NULL, 2);
+	ftdi_i2c_flush(&ctx);
+	CHECK(PinsKept(0x05, 0x0D));
+	/* Reads use the same bit layout as writes */
+	CHECK(ftdi_i2c_queue_gpio_get(&ctx, FTDI_I2C_GPIOL, &value, &status) == 0);
+	SetReply(reply, 1);
+	CHECK(ftdi_i2c_flush(&ctx) == 0 && value == 0x0A);
+	/* The FT4232H has no high byte, the FT2232H high byte is read as it is */
+	ctx.ftdic.type = TYPE_4232H;
+	CHECK(ftdi_i2c_queue_gpio_set(&ctx, FTDI_I2C_GPIOH, 0x01, 0x01) == FTDI_I2C_EINVAL);
+	CHECK(ftdi_i2c_queue_gpio_get(&ctx, FTDI_I2C_GPIOH, &high, &status) == FTDI_I2C_EINVAL);
+	ctx.ftdic.type = TYPE_2232H;
+	CHECK(ftdi_i2c_queue_gpio_get(&ctx, FTDI_I2C_GPIOL, &value, &status) == 0);
+	CHECK(ftdi_i2c_queue_gpio_get(&ctx, FTDI_I2C_GPIOH, &high, &status) == 0);
+	SetReply(reply, 2);
+	CHECK(ftdi_i2c_flush(&ctx) == 0 && value == 0x0A && high == 0x5C);
+}
+
+int main(void) {
+	TestQueue();
+	TestLongRead();
+	TestTransfer();
+	TestInvalid();
+	TestAsync();
+	TestClose();
+	TestDelay();
+	TestGPIO();
+	printf("test-ftdi-i2c: %s\n", failed ? "FAILED" : "OK");
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,87 @@
+/*
+ | Tests of device path parsing and mux select planning (i2cmux.c), run by make check.
+ |
+ | Written by Ori Idan, Helicon technologies LTD. (ori@helicontech.co.il)
+ |
+ | This file is free software: you can redistribute it and/or modify it
+ | under the terms of the GNU General Public License as published by the
+ | Free Software Foundation, either version 3 of the License, or
+ | (at your option) any later version.
+ |
+ | This file is distributed in the hope that it will be useful, but
+ | WITHOUT ANY WARRANTY; without even the implied warranty of
+ | MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ | See the GNU General Public License for more details.
+ |
+ | You should have received a copy of the GNU General Public License along
+ | with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <stdio.h>
+#include <string.h>
+#include "i2cmux.h"
+
+static int failed = 0;
+
+#define CHECK(c) do { if(!(c)) { printf("%s:%d: %s failed\n", __FILE__, __LINE__, #c); failed++; } } while(0)
+
+/*
+ | Plan:
+ | Plan select of path and return the writes as text, e.g. "70<=08 74<=01".
+ */
+static const char *Plan(struct i2c_mux_state *state, const char *s) {
+	static char text[128];
+	struct i2c_mux_write writes[I2C_MAX_MUX_WRITES];
+	struct i2c_path path;
+	int i, n;
+
+	text[0] = '\0';
+	if(ParseI2CPath(s, &path) < 0)
+		return "invalid";
+	n = MuxPlanSelect(state, &path, writes);
+	CHECK(n <= I2C_MAX_MUX_WRITES);
+	for(i = 0; i < n; i++)
+		sprintf(text + strlen(text), "%s%02x<=%02x", i ? " " : "", writes[i].mux, writes[i].value);
+	return text;
+}
+
+static void TestParse(void) {
+	struct i2c_path path;
+
+	CHECK(ParseI2CPath("0x48", &path) == 0 && path.nmux == 0 && path.addr == 0x48);
+	CHECK(ParseI2CPath("48", &path) == 0 && path.addr == 0x48);
+	CHECK(ParseI2CPath("mux@0x70/ch3/mux@74/ch0/0x49", &path) == 0);
+	CHECK(path.nmux == 2 && path.mux[0] == 0x70 && path.chan[0] == 3 && path.mux[1] == 0x74 && path.chan[1] == 0 && path.addr == 0x49);
+	CHECK(ParseI2CPath("mux@0x70/ch8/0x48", &path) < 0);
+	CHECK(ParseI2CPath("mux@0x70/0x48", &path) < 0);
+	CHECK(ParseI2CPath("0x4G", &path) < 0);
+	CHECK(ParseI2CPath("mux@70/ch0/mux@71/ch0/mux@72/ch0/mux@73/ch0/mux@74/ch0/0x48", &path) < 0);
+}
+
+static void TestPlan(void) {
+	struct i2c_mux_state state;
+
+	memset(&state, 0, sizeof(state));
+	CHECK(strcmp(Plan(&state, "mux@0x70/ch3/mux@0x74/ch0/0x48"), "70<=08 74<=01") == 0);
+	CHECK(strcmp(Plan(&state, "mux@0x70/ch3/mux@0x74/ch0/0x49"), "") == 0);	// Already selected
+	/* Downstream mux is closed before the upstream channel changes */
+	CHECK(strcmp(Plan(&state, "mux@0x70/ch5/0x48"), "74<=00 70<=20") == 0);
+	CHECK(strcmp(Plan(&state, "mux@0x70/ch3/0x49"), "70<=08") == 0);
+	/* Another mux at the same level is disconnected */
+	CHECK(strcmp(Plan(&state, "mux@0x71/ch0/0x48"), "70<=00 71<=01") == 0);
+	/* A mux left open below the device is closed */
+	CHECK(strcmp(Plan(&state, "0x50"), "71<=00") == 0);
+	CHECK(strcmp(Plan(&state, "0x50"), "") == 0);
+	/* Deepest mux is closed first, while it is still reachable */
+	CHECK(strcmp(Plan(&state, "mux@70/ch0/mux@74/ch1/mux@75/ch2/mux@76/ch3/0x50"), "70<=01 74<=02 75<=04 76<=08") == 0);
+	CHECK(strcmp(Plan(&state, "mux@71/ch0/0x50"), "76<=00 75<=00 74<=00 70<=00 71<=01") == 0);
+	/* Nothing is known after a failure */
+	MuxInvalidate(&state);
+	CHECK(strcmp(Plan(&state, "mux@71/ch0/0x50"), "71<=01") == 0);
+}
+
+int main(void) {
+	TestParse();
+	TestPlan();
+	printf("test-i2cmux: %s\n", failed ? "FAILED" : "OK");
+	return failed ? 1 : 0;
+}
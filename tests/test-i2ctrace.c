@@ -0,0 +1,150 @@
+/*
+ | Tests of the trace decoder and replayer (i2ctrace.c) on a small canned trace, run by make check.
+ | i2ctrace is included so Process() can be run without the command line.
+ |
+ | Written by Ori Idan, Helicon technologies LTD. (ori@helicontech.co.il)
+ |
+ | This file is free software: you can redistribute it and/or modify it
+ | under the terms of the GNU General Public License as published by the
+ | Free Software Foundation, either version 3 of the License, or
+ | (at your option) any later version.
+ |
+ | This file is distributed in the hope that it will be useful, but
+ | WITHOUT ANY WARRANTY; without even the implied warranty of
+ | MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ | See the GNU General Public License for more details.
+ |
+ | You should have received a copy of the GNU General Public License along
+ | with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#define main I2CTraceMain
+#include "../i2ctrace.c"
+#undef main
+
+#include <fcntl.h>
+#include <unistd.h>
+
+static int failed = 0;
+
+#define CHECK(c) do { if(!(c)) { printf("%s:%d: %s failed\n", __FILE__, __LINE__, #c); failed++; } } while(0)
+
+static char tracefile[] = "/tmp/test-i2ctraceXXXXXX";
+static char outfile[] = "/tmp/test-i2ctrace-outXXXXXX";
+
+/*
+ | Write of 0x0F to 0x48 at 1 MHz (clock divisor 29), data byte not acknowledged.
+ | The header has the 200 kHz default, the divisor was changed before the bus was opened.
+ */
+static const unsigned char Commands[] = {
+	0x86, 0x1D, 0x00,	// Set clock divisor
+	0x80, 0x03, 0x03, 0x80, 0x01, 0x03, 0x80, 0x00, 0x03,	// START
+	0x11, 0x00, 0x00, 0x90, 0x80, 0x00, 0x01, 0x22, 0x00, 0x80, 0x02, 0x03,	// Address and ACK bit
+	0x11, 0x00, 0x00, 0x0F, 0x80, 0x00, 0x01, 0x22, 0x00, 0x80, 0x02, 0x03,	// Data and ACK bit
+	0x80, 0x01, 0x03, 0x80, 0x03, 0x03, 0x80, 0x00, 0x00,	// STOP and release
+	0x87,
+};
+static const unsigned char Replies[] = { 0x00, 0x01 };
+
+static void Put32(unsigned char *p, unsigned long v) {
+	p[0] = v;
+	p[1] = v >> 8;
+	p[2] = v >> 16;
+	p[3] = v >> 24;
+}
+
+/*
+ | PutRecord:
+ | Append trace record to f.
+ */
+static void PutRecord(FILE *f, unsigned char type, const unsigned char *data, unsigned int len, unsigned long start_ns, unsigned long duration_us) {
+	unsigned char r[FTDI_I2C_TRACE_RECORD_SIZE];
+
+	memset(r, 0, sizeof(r));
+	r[0] = type;
+	Put32(r + 4, len);
+	Put32(r + 8, start_ns);
+	Put32(r + 16, duration_us);
+	fwrite(r, 1, sizeof(r), f);
+	fwrite(data, 1, len, f);
+}
+
+static void WriteTrace(void) {
+	unsigned char header[FTDI_I2C_TRACE_HEADER_SIZE];
+	FILE *f = fopen(tracefile, "wb");
+
+	memset(header, 0, sizeof(header));
+	memcpy(header, FTDI_I2C_TRACE_MAGIC, 8);
+	Put32(header + 8, 0x95);
+	fwrite(header, 1, sizeof(header), f);
+	PutRecord(f, FTDI_I2C_TRACE_WRITE, Commands, sizeof(Commands), 1000000, 50);
+	PutRecord(f, FTDI_I2C_TRACE_READ, Replies, sizeof(Replies), 1060000, 10);
+	fclose(f);
+}
+
+/*
+ | Output:
+ | Run Process() with its output going to text, return its result.
+ */
+static int Output(int decode, long divisor, char *text, int size) {
+	int saved, fd, r, n;
+
+	fflush(stdout);
+	saved = dup(1);
+	fd = open(outfile, O_WRONLY | O_TRUNC);
+	dup2(fd, 1);
+	close(fd);
+	r = Process(tracefile, decode, divisor);
+	fflush(stdout);
+	dup2(saved, 1);
+	close(saved);
+	fd = open(outfile, O_RDONLY);
+	n = read(fd, text, size - 1);
+	close(fd);
+	text[(n > 0) ? n : 0] = '\0';
+	return r;
+}
+
+static void TestDecode(void) {
+	char text[4096];
+
+	CHECK(Output(1, -1, text, sizeof(text)) == 0);
+	CHECK(strstr(text, "SCL 1000.0 kHz\n") != NULL);
+	CHECK(strstr(text, " START\n") != NULL);
+	CHECK(strstr(text, "ADDR  0x48 W ACK\n") != NULL);
+	CHECK(strstr(text, "WRITE 0x0F NACK\n") != NULL);
+	/* 18 clocks of 1 us and 7 pin writes between START and STOP */
+	CHECK(strstr(text, "STOP  transaction 1: 70 us recorded, 19 us on bus\n") != NULL);
+	CHECK(strstr(text, "missing") == NULL && strstr(text, "not expected") == NULL);
+}
+
+static void TestReplay(void) {
+	char text[4096];
+
+	CHECK(Output(0, -1, text, sizeof(text)) == 0);
+	CHECK(strstr(text, "SCL: 1000.0 kHz\n") != NULL);
+	CHECK(strstr(text, "USB: 1 writes (46 bytes), 1 reads (2 bytes), 1 round trips\n") != NULL);
+	CHECK(strstr(text, "Transactions: 1, average 70 us recorded, 19 us on bus") != NULL);
+	/* -d overrides the recorded divisor */
+	CHECK(Output(0, 0x95, text, sizeof(text)) == 0);
+	CHECK(strstr(text, "SCL: 200.0 kHz\n") != NULL);
+	CHECK(strstr(text, "average 70 us recorded, 91 us on bus") != NULL);
+}
+
+int main(void) {
+	int fd = mkstemp(tracefile);
+	int out = mkstemp(outfile);
+
+	if(fd < 0 || out < 0) {
+		printf("Can't create temporary files\n");
+		return 1;
+	}
+	close(fd);
+	close(out);
+	WriteTrace();
+	TestDecode();
+	TestReplay();
+	unlink(tracefile);
+	unlink(outfile);
+	printf("test-i2ctrace: %s\n", failed ? "FAILED" : "OK");
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,164 @@
+/*
+ | Tests of the register shadow cache (regcache.c), run by make check.
+ |
+ | Written by Ori Idan, Helicon technologies LTD. (ori@helicontech.co.il)
+ |
+ | This file is free software: you can redistribute it and/or modify it
+ | under the terms of the GNU General Public License as published by the
+ | Free Software Foundation, either version 3 of the License, or
+ | (at your option) any later version.
+ |
+ | This file is distributed in the hope that it will be useful, but
+ | WITHOUT ANY WARRANTY; without even the implied warranty of
+ | MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.
+ | See the GNU General Public License for more details.
+ |
+ | You should have received a copy of the GNU General Public License along
+ | with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "regcache.h"
+
+static int failed = 0;
+
+#define CHECK(c) do { if(!(c)) { printf("%s:%d: %s failed\n", __FILE__, __LINE__, #c); failed++; } } while(0)
+
+static char filename[] = "/tmp/test-regcacheXXXXXX";
+
+/*
+ | WriteFile:
+ | Replace cache file contents.
+ */
+static void WriteFile(const char *text) {
+	FILE *f = fopen(filename, "w");
+
+	fputs(text, f);
+	fclose(f);
+}
+
+/*
+ | FileContains:
+ | Return 1 if line is in the cache file.
+ */
+static int FileContains(const char *line) {
+	char buf[256];
+	FILE *f = fopen(filename, "r");
+	int found = 0;
+
+	while(fgets(buf, sizeof(buf), f) != NULL) {
+		if(strcmp(buf, line) == 0)
+			found = 1;
+	}
+	fclose(f);
+	return found;
+}
+
+static void TestLookup(void) {
+	struct i2c_path dev, other;
+	unsigned char data[2] = { 0x12, 0x34 };
+	unsigned char buf[4];
+
+	ParseI2CPath("mux@0x70/ch3/0x48", &dev);
+	ParseI2CPath("0x48", &other);
+	WriteFile("mux@0x70/ch3/0x48 0x0F wt\n0x48 0x0F 60\n0x48 0x10 0\n");
+	CHECK(RegCacheOpen(filename) == 0);
+	CHECK(RegCacheLookup(&dev, 0x0F, buf, 2) == 0);	// Nothing cached yet
+	RegCacheStore(&dev, 0x0F, data, 2);
+	CHECK(RegCacheLookup(&dev, 0x0F, buf, 2) == 1 && buf[0] == 0x12 && buf[1] == 0x34);
+	CHECK(RegCacheLookup(&dev, 0x0F, buf, 3) == 0);	// Longer than cached
+	CHECK(RegCacheLookup(&other, 0x0F, buf, 2) == 0);	// Same address, other mux path
+	CHECK(RegCacheLookup(&dev, 0x20, buf, 1) == 0);	// Not declared
+	RegCacheStore(&other, 0x10, data, 1);
+	CHECK(RegCacheLookup(&other, 0x10, buf, 1) == 0);	// ttl 0 expires at once
+	RegCacheClose();
+	/* Value and counters survive in the file */
+	CHECK(RegCacheOpen(filename) == 0);
+	CHECK(RegCacheLookup(&dev, 0x0F, buf, 2) == 1 && buf[1] == 0x34);
+	RegCacheClose();
+}
+
+static void TestWrite(void) {
+	struct i2c_path dev;
+	unsigned char data[2] = { 0x12, 0x34 };
+	unsigned char w[2] = { 0xAA, 0xBB };
+	unsigned char buf[2];
+
+	ParseI2CPath("0x48", &dev);
+	WriteFile("0x48 0x0F wt\n0x48 0x20 60\n");
+	CHECK(RegCacheOpen(filename) == 0);
+	RegCacheStore(&dev, 0x0F, data, 2);
+	RegCacheStore(&dev, 0x20, data, 2);
+	/* Write to 0x10-0x11 overlaps the second byte of the write-through entry */
+	RegCacheWrite(&dev, 0x10, w, 2, 1);
+	CHECK(RegCacheLookup(&dev, 0x0F, buf, 2) == 1 && buf[0] == 0x12 && buf[1] == 0xAA);
+	CHECK(RegCacheLookup(&dev, 0x20, buf, 2) == 1);	// Not overlapping
+	/* ttl entries are invalidated by writes */
+	RegCacheWrite(&dev, 0x21, w, 1, 1);
+	CHECK(RegCacheLookup(&dev, 0x20, buf, 2) == 0);
+	/* A failed write invalidates the whole device */
+	RegCacheWrite(&dev, 0x40, w, 1, 0);
+	CHECK(RegCacheLookup(&dev, 0x0F, buf, 2) == 0);
+	RegCacheClose();
+}
+
+static void TestFile(void) {
+	struct i2c_path dev;
+	unsigned char buf[1];
+
+	ParseI2CPath("0x48", &dev);
+	WriteFile("# sensors\n0x48 0x1G 60\n\n0x48 0x01 6x\n0x48 0x02 60 ZZ\n0x48 0x03 60 AB 10 1 2\n");
+	CHECK(RegCacheOpen(filename) == 0);
+	CHECK(RegCacheLookup(&dev, 0x01, buf, 1) == 0);
+	RegCacheClose();
+	/* Comments and invalid lines are written back as they were */
+	CHECK(FileContains("# sensors\n"));
+	CHECK(FileContains("0x48 0x1G 60\n"));
+	CHECK(FileContains("\n"));
+	CHECK(FileContains("0x48 0x01 6x\n"));
+	CHECK(FileContains("0x48 0x02 60 ZZ\n"));
+	CHECK(FileContains("0x48 0x03 60 AB 10 1 2\n"));
+}
+
+static void TestCounters(void) {
+	struct i2c_path dev;
+	unsigned char buf[1];
+	char text[256], line[128];
+
+	/* Counters past 2^31 are kept, at ULONG_MAX they stay there */
+	ParseI2CPath("0x48", &dev);
+	snprintf(text, sizeof(text), "0x48 0x04 wt CD 10 4000000000 5\n0x48 0x05 wt EF 10 %lu 5\n0x48 0x06 wt 01 10 -1 5\n"
+			"0x48 0x07 wt 02 10 99999999999999999999999 5\n", ULONG_MAX);
+	WriteFile(text);
+	CHECK(RegCacheOpen(filename) == 0);
+	CHECK(RegCacheLookup(&dev, 0x04, buf, 1) == 1 && buf[0] == 0xCD);
+	CHECK(RegCacheLookup(&dev, 0x05, buf, 1) == 1 && buf[0] == 0xEF);
+	CHECK(RegCacheLookup(&dev, 0x06, buf, 1) == 0);	// Invalid, not in the cache
+	CHECK(RegCacheLookup(&dev, 0x07, buf, 1) == 0);
+	RegCacheClose();
+	CHECK(FileContains("0x48 0x04 wt CD 10 4000000001 5\n"));
+	snprintf(line, sizeof(line), "0x48 0x05 wt EF 10 %lu 5\n", ULONG_MAX);
+	CHECK(FileContains(line));
+	CHECK(FileContains("0x48 0x06 wt 01 10 -1 5\n"));
+	CHECK(FileContains("0x48 0x07 wt 02 10 99999999999999999999999 5\n"));
+}
+
+int main(void) {
+	int fd = mkstemp(filename);
+
+	if(fd < 0) {
+		printf("Can't create %s\n", filename);
+		return 1;
+	}
+	close(fd);
+	TestLookup();
+	TestWrite();
+	TestFile();
+	TestCounters();
+	unlink(filename);
+	printf("test-regcache: %s\n", failed ? "FAILED" : "OK");
+	return failed ? 1 : 0;
+}